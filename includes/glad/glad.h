@@ -7,15 +7,16 @@
     APIs: gl=4.5
     Profile: compatibility
     Extensions:
+        GL_ARB_buffer_storage,
         GL_KHR_debug
     Loader: True
     Local files: False
     Omit khrplatform: False
 
     Commandline:
-        --profile="compatibility" --api="gl=4.5" --generator="c" --spec="gl" --extensions="GL_KHR_debug"
+        --profile="compatibility" --api="gl=4.5" --generator="c" --spec="gl" --extensions="GL_ARB_buffer_storage,GL_KHR_debug"
     Online:
-        http://glad.dav1d.de/#profile=compatibility&language=c&specification=gl&loader=on&api=gl%3D4.5&extensions=GL_KHR_debug
+        http://glad.dav1d.de/#profile=compatibility&language=c&specification=gl&loader=on&api=gl%3D4.5&extensions=GL_ARB_buffer_storage&extensions=GL_KHR_debug
 */
 
 
@@ -5199,6 +5200,10 @@ GLAPI PFNGLTEXTUREBARRIERPROC glad_glTextureBarrier;
 #define GL_CONTEXT_FLAG_DEBUG_BIT_KHR 0x00000002
 #define GL_STACK_OVERFLOW_KHR 0x0503
 #define GL_STACK_UNDERFLOW_KHR 0x0504
+#ifndef GL_ARB_buffer_storage
+#define GL_ARB_buffer_storage 1
+GLAPI int GLAD_GL_ARB_buffer_storage;
+#endif
 #ifndef GL_KHR_debug
 #define GL_KHR_debug 1
 GLAPI int GLAD_GL_KHR_debug;
@@ -0,0 +1,9 @@
+// Per-frame camera data, uploaded once by Renderer::BeginScene (binding 0)
+layout (std140) uniform CameraData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 time;
+};
\ No newline at end of file
@@ -15,10 +15,13 @@
 #include <iostream>
 
 #include "utils/Shader.h"
+#include "utils/ShaderLibrary.h"
 #include "utils/Camera.h"
 #include "utils/Model.h"
 #include "utils/Renderer.h"
+#include "utils/GeometryUploadQueue.h"
 #include "utils/Skybox.h"
+#include "utils/Profiler.h"
 
 
 #pragma region window and camera
@@ -82,7 +85,7 @@ glm::vec3 bezierPointLookAt(float t, glm::vec3 start, glm::vec3 p1, glm::vec3 p2
 
 Mesh GenerateCubic(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, int segments)
 {
-    std::vector<Vertex> vertices;
+    std::vector<PositionVertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
 
@@ -91,13 +94,13 @@ Mesh GenerateCubic(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, int s
         float t = (float)i / (float)segments;
         glm::vec3 pos = bezierPoint(t, p0, p1, p2, p3);
 
-        Vertex v;
+        PositionVertex v;
         v.Position = pos;
         vertices.push_back(v);
         indices.push_back(i);
     }
 
-    return Mesh(vertices, indices, textures, GL_LINE_STRIP);
+    return Mesh(vertices, std::move(indices), std::move(textures), GL_LINE_STRIP);
 }
 
 void appendKeyFrame(const std::vector<glm::vec3>& keyPoints, int frameCount)
@@ -200,8 +203,17 @@ int main()
     ImGui_ImplOpenGL3_Init("#version 330");
 #pragma endregion imgui
 
+    // Shaders compile in the background and recompile when edited
+    Shader::SetAsyncCompilation(true);
+    Shader::SetHotReload(true);
 
-    Model aeroplane(RE("aeroplane.glb"), RE("aeroplane.vs"), RE("aeroplane.fs"));
+    // Asset loading is recorded as its own profiler frame
+    Profiler::BeginFrame();
+    // Heap-allocated so they are destroyed while the context and GL state cache still exist
+    Model* aeroplane = new Model(RE("aeroplane.glb"), RE("mesh.vs"), RE("aeroplane.fs"));
+    // Nothing reads the aeroplane's vertices back, so only the GPU copy stays.
+    // Released once its uploads have landed; earlier would wait on the workers.
+    bool aeroplaneCpuData = true;
 
     std::vector<std::string> skybox_paths = {
         RE("skybox/miramar_lf.tga"),
@@ -212,11 +224,10 @@ int main()
         RE("skybox/miramar_bk.tga"),
 
     };
-    Skybox skybox = Skybox(skybox_paths,RE("skybox/skybox.vs"), RE("skybox/skybox.fs"));
+    Skybox* skybox = new Skybox(skybox_paths,RE("skybox/skybox.vs"), RE("skybox/skybox.fs"));
+    Profiler::EndFrame();
 
 
-    Shader* lineShader = new Shader("line.vs", "line.fs");
-
     float len = 80.0f;
     float width = 20.0f;
     float mid = len / 2.0f;
@@ -253,13 +264,16 @@ int main()
             segments
         ));
     }
-    Model* bezierCurveModel = new Model(meshes, lineShader);
+    Model* bezierCurveModel = new Model(std::move(meshes), "mesh.vs", "line.fs");
     appendKeyFrame(points, 800);
 
     Renderer::Init();
+    Renderer::SetLodThreshold(1.0f, (float)window_height);
+    LodState aeroplaneLod;
 
     while (!glfwWindowShouldClose(window))
     {
+        Profiler::BeginFrame();
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
@@ -274,7 +288,7 @@ int main()
 
         {
             ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Always);
-            ImGui::SetNextWindowSize(ImVec2(380, 280), ImGuiCond_Always);
+            ImGui::SetNextWindowSize(ImVec2(380, 380), ImGuiCond_Always);
             ImGui::Begin("Aeroplane Control Panels");
 
             ImGui::Text("Rotation Mode:");
@@ -346,13 +360,34 @@ int main()
                 targetQuat = glm::identity<glm::quat>();
                 planePos = glm::vec3(0.0f, 0.0f, 0.0f);
             }
+            ImGui::NewLine();
+
+            const RendererStats& stats = Renderer::GetStats();
+            ImGui::Text("Renderer Stats");
+            ImGui::Text("Submitted: %u  Visible: %u  Culled: %u", stats.submitted, stats.visible, stats.culled);
+            ImGui::Text("Draw calls: %u%s", stats.drawCalls, Renderer::IsIndirectDrawingSupported() ? " (multi-draw indirect)" : "");
+            ImGui::Text("GL state changes: %u  Skipped: %u", stats.stateChanges, stats.stateChangesSkipped);
+            bool depthPrepass = Renderer::IsDepthPrepassEnabled();
+            if (ImGui::Checkbox("Depth pre-pass", &depthPrepass))
+                Renderer::SetDepthPrepass(depthPrepass);
+            if (depthPrepass)
+            {
+                ImGui::SameLine();
+                ImGui::Text("(%u draws)", stats.depthPrepassDrawCalls);
+            }
+            ImGui::Text("Shader programs: %zu", ShaderLibrary::ProgramCount());
+            ImGui::Text("Aeroplane LOD: %u / %zu", aeroplaneLod.level, aeroplane->lodErrors.size() - 1);
+            ImGui::Text("Meshlets culled: %u / %u", stats.meshletsCulled, stats.meshletsTested);
+            GeometryUploadStats uploads = GeometryUploadQueue::GetStats();
+            ImGui::Text("Geometry uploads pending: %u (%.0f KB last frame)", uploads.pending, uploads.bytesCopied / 1024.0f);
             ImGui::End();
         }
+        Profiler::DrawImGui();
 #pragma endregion
 
 
-        Renderer::BeginScene(camera, (float)window_width / (float)window_height);
-        Renderer::SetSkybox(skybox);
+        Renderer::BeginScene(camera, (float)window_width / (float)window_height, currentFrame);
+        Renderer::SetSkybox(*skybox);
         if (isFlying)
         {
             Renderer::Submit(*bezierCurveModel, glm::mat4(1.0f));
@@ -388,16 +423,30 @@ int main()
             model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
             model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
 
-            Renderer::Submit(aeroplane, model);
+            Renderer::Submit(*aeroplane, model, &aeroplaneLod);
         }
         Renderer::EndScene();
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (aeroplaneCpuData && aeroplane->IsResident())
+        {
+            aeroplane->ReleaseCpuData();
+            aeroplaneCpuData = false;
+        }
+        {
+            PROFILE_SCOPE("ImGui::Render");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        Profiler::EndFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    delete bezierCurveModel;
+    delete aeroplane;
+    delete skybox;
     Renderer::Shutdown();
+    Profiler::Shutdown();
+    Shader::ReleaseShared();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
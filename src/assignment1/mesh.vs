@@ -0,0 +1,30 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// Must match the depth pre-pass bit for bit (Shader::DepthOnly)
+invariant gl_Position;
+#ifdef TEXTURED
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+#endif
+
+#include "camera.glsl"
+
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+#else
+uniform mat4 model;
+#endif
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 world = aInstanceModel;
+#else
+    mat4 world = model;
+#endif
+#ifdef TEXTURED
+    TexCoords = aTexCoords;
+#endif
+    gl_Position = viewProjection * world * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+// Decoders for the compact vertex formats in VertexFormat.h
+
+// Location 1: octahedral normal, snorm16x2
+vec3 decodeOctNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+vec3 rotateByQuat(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Location 3: QTangent, snorm16x4; returns mat3(tangent, bitangent, normal)
+mat3 decodeQTangent(vec4 q)
+{
+    q = normalize(q);
+    vec3 t = rotateByQuat(q, vec3(1.0, 0.0, 0.0));
+    vec3 n = rotateByQuat(q, vec3(0.0, 0.0, 1.0));
+    float handedness = q.w < 0.0 ? -1.0 : 1.0;
+    return mat3(t, cross(n, t) * handedness, n);
+}
\ No newline at end of file
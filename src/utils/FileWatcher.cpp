@@ -0,0 +1,106 @@
+#include "FileWatcher.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static constexpr std::chrono::milliseconds kPollInterval(250);
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+        std::cout << "WARNING::FILE_WATCHER::INOTIFY_UNAVAILABLE, polling instead" << std::endl;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (inotifyFd >= 0) close(inotifyFd);
+#endif
+}
+
+std::string FileWatcher::Canonical(const std::string& path)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? path : canonical.string();
+}
+
+void FileWatcher::Watch(const std::string& path)
+{
+    const std::string canonical = Canonical(path);
+    if (!files.emplace(canonical, path).second) return;
+
+#ifdef __linux__
+    if (inotifyFd >= 0)
+    {
+        const std::string directory = std::filesystem::path(canonical).parent_path().string();
+        bool watched = std::any_of(directories.begin(), directories.end(),
+                                   [&](const auto& entry) { return entry.second == directory; });
+        if (!watched)
+        {
+            int wd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0) directories[wd] = directory;
+            else std::cout << "WARNING::FILE_WATCHER::CANNOT_WATCH: " << directory << std::endl;
+        }
+        return;
+    }
+#endif
+
+    std::error_code error;
+    stamps[canonical] = std::filesystem::last_write_time(canonical, error);
+}
+
+std::vector<std::string> FileWatcher::PollChanged()
+{
+    std::vector<std::string> changed;
+    auto report = [&](const std::string& canonical) {
+        auto it = files.find(canonical);
+        if (it != files.end() && std::find(changed.begin(), changed.end(), it->second) == changed.end())
+            changed.push_back(it->second);
+    };
+
+#ifdef __linux__
+    if (inotifyFd >= 0)
+    {
+        alignas(inotify_event) char buffer[4096];
+        for (;;)
+        {
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) break;
+
+            for (char* p = buffer; p < buffer + length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                auto dir = directories.find(event->wd);
+                if (dir != directories.end() && event->len > 0)
+                    report((std::filesystem::path(dir->second) / event->name).string());
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+#endif
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPoll < kPollInterval) return changed;
+    lastPoll = now;
+
+    for (auto& [canonical, stamp] : stamps)
+    {
+        std::error_code error;
+        auto current = std::filesystem::last_write_time(canonical, error);
+        if (!error && current != stamp)
+        {
+            stamp = current;
+            report(canonical);
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reports edits to a set of files without blocking.
+//
+// On Linux this is an inotify descriptor watching the files' directories
+// (editors often save by writing a new file and renaming it over the old
+// one, which a watch on the file itself would miss). Elsewhere it falls back
+// to comparing modification times a few times per second.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    void Watch(const std::string& path);
+
+    // Paths, as passed to Watch, that changed since the previous call
+    std::vector<std::string> PollChanged();
+
+    // The key files are watched under; the path itself if it cannot be resolved
+    static std::string Canonical(const std::string& path);
+
+private:
+    // Canonical path -> path as registered
+    std::unordered_map<std::string, std::string> files;
+
+    int inotifyFd = -1;
+    // Watch descriptor -> canonical directory
+    std::unordered_map<int, std::string> directories;
+
+    // Polling fallback
+    std::unordered_map<std::string, std::filesystem::file_time_type> stamps;
+    std::chrono::steady_clock::time_point lastPoll;
+};
@@ -0,0 +1,192 @@
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLING_SSE
+#endif
+
+Frustum Frustum::FromMatrix(const glm::mat4& m)
+{
+    // Gribb/Hartmann: planes are sums/differences of the rows of the clip matrix
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum f;
+    f.planes[0] = row3 + row0;
+    f.planes[1] = row3 - row0;
+    f.planes[2] = row3 + row1;
+    f.planes[3] = row3 - row1;
+    f.planes[4] = row3 + row2;
+    f.planes[5] = row3 - row2;
+    for (glm::vec4& p : f.planes)
+        p /= glm::length(glm::vec3(p));
+    return f;
+}
+
+void BoxSoA::Push(const AABB& localBounds, const glm::mat4& transform)
+{
+    if (count + 1 > centerX.size())
+    {
+        size_t padded = (count + 8) & ~size_t(7);
+        for (auto* v : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+            v->resize(padded, 0.0f);
+    }
+
+    glm::vec3 center, extents;
+    if (localBounds.Valid())
+    {
+        // Arvo: transform the center, extents go through the absolute 3x3
+        glm::vec3 c = localBounds.Center();
+        glm::vec3 e = localBounds.Extents();
+        center = glm::vec3(transform * glm::vec4(c, 1.0f));
+        glm::mat3 absRot(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2])));
+        extents = absRot * e;
+    }
+    else
+    {
+        // Nothing to bound (e.g. an empty model): never cull it
+        center = glm::vec3(0.0f);
+        extents = glm::vec3(FLT_MAX);
+    }
+
+    centerX[count] = center.x; centerY[count] = center.y; centerZ[count] = center.z;
+    extentX[count] = extents.x; extentY[count] = extents.y; extentZ[count] = extents.z;
+    ++count;
+}
+
+// A box is outside when, for some plane, even its most positive corner is behind it:
+// dot(n, c) + w + dot(|n|, e) < 0
+static bool CullOneBox(const Frustum& frustum, const BoxSoA& b, size_t i)
+{
+    for (const glm::vec4& p : frustum.planes)
+    {
+        float d = p.x * b.centerX[i] + p.y * b.centerY[i] + p.z * b.centerZ[i] + p.w;
+        float r = std::fabs(p.x) * b.extentX[i] + std::fabs(p.y) * b.extentY[i] + std::fabs(p.z) * b.extentZ[i];
+        if (d + r < 0.0f) return false;
+    }
+    return true;
+}
+
+size_t CullBoxes(const Frustum& frustum, const BoxSoA& b, uint8_t* visible)
+{
+    const size_t count = b.Size();
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&b.centerX[i]), cy = _mm256_loadu_ps(&b.centerY[i]), cz = _mm256_loadu_ps(&b.centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&b.extentX[i]), ey = _mm256_loadu_ps(&b.extentY[i]), ez = _mm256_loadu_ps(&b.extentZ[i]);
+        __m256 outside = _mm256_setzero_ps();
+        for (const glm::vec4& p : frustum.planes)
+        {
+            __m256 nx = _mm256_set1_ps(p.x), ny = _mm256_set1_ps(p.y), nz = _mm256_set1_ps(p.z);
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                     _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(p.w)));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex),
+                                                   _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)),
+                                     _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        int mask = _mm256_movemask_ps(outside);
+        for (int k = 0; k < 8; ++k)
+        {
+            visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+            visibleCount += visible[i + k];
+        }
+    }
+#elif defined(FRUSTUM_CULLING_SSE)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&b.centerX[i]), cy = _mm_loadu_ps(&b.centerY[i]), cz = _mm_loadu_ps(&b.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&b.extentX[i]), ey = _mm_loadu_ps(&b.extentY[i]), ez = _mm_loadu_ps(&b.extentZ[i]);
+        __m128 outside = _mm_setzero_ps();
+        for (const glm::vec4& p : frustum.planes)
+        {
+            __m128 nx = _mm_set1_ps(p.x), ny = _mm_set1_ps(p.y), nz = _mm_set1_ps(p.z);
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                  _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(p.w)));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                                             _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                  _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; ++k)
+        {
+            visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+            visibleCount += visible[i + k];
+        }
+    }
+#endif
+
+    // Tail, or the whole range on targets without SSE
+    for (; i < count; ++i)
+    {
+        visible[i] = CullOneBox(frustum, b, i) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+MeshletCullView MeshletCullView::Make(const Frustum& frustum, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition)
+{
+    MeshletCullView view;
+    view.frustum = &frustum;
+    view.modelMatrix = modelMatrix;
+    view.localCamera = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+    view.scale = std::sqrt(std::max({glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+                                     glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1])),
+                                     glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]))}));
+    view.mirrored = glm::determinant(glm::mat3(modelMatrix)) < 0.0f;
+    return view;
+}
+
+// Front/back-facing is preserved by affine transforms, so the cone test runs
+// in model space against the camera moved there; only the frustum test needs
+// the sphere in world space
+static bool MeshletVisible(const Meshlet& m, const MeshletCullView& view, bool coneTest)
+{
+    if (coneTest)
+    {
+        glm::vec3 toCenter = m.center - view.localCamera;
+        if (glm::dot(toCenter, m.coneAxis) >= m.coneCutoff * glm::length(toCenter) + m.radius)
+            return false;
+    }
+
+    glm::vec3 center = glm::vec3(view.modelMatrix * glm::vec4(m.center, 1.0f));
+    float radius = m.radius * view.scale;
+    for (const glm::vec4& plane : view.frustum->planes)
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    return true;
+}
+
+void CullMeshlets(const std::vector<Meshlet>& meshlets, MeshletCullView& view, bool backFacesCulled, std::vector<IndexRange>& out)
+{
+    const bool coneTest = backFacesCulled && !view.mirrored;
+    bool extendLast = false;
+    for (const Meshlet& m : meshlets)
+    {
+        view.tested++;
+        if (!MeshletVisible(m, view, coneTest))
+        {
+            view.culled++;
+            extendLast = false;
+            continue;
+        }
+        // Meshlets are consecutive in the index list, so neighbours join up
+        if (extendLast) out.back().indexCount += m.indexCount;
+        else out.push_back({m.firstIndex, m.indexCount});
+        extendLast = true;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "RenderTypes.h"
+
+struct Frustum {
+    // left, right, bottom, top, near, far; xyz = inward normal, w = distance
+    glm::vec4 planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& viewProjection);
+};
+
+// World-space boxes as center/extents in structure-of-arrays form so the
+// culling kernel can load 4 (SSE) or 8 (AVX) boxes per instruction.
+// Storage is padded to a multiple of 8 and kept across frames.
+class BoxSoA {
+public:
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    void Clear() { count = 0; }
+    void Push(const AABB& localBounds, const glm::mat4& transform);
+    size_t Size() const { return count; }
+
+private:
+    size_t count = 0;
+};
+
+// Writes 1 to visible[i] when box i intersects the frustum, 0 otherwise.
+// Returns the number of visible boxes.
+size_t CullBoxes(const Frustum& frustum, const BoxSoA& boxes, uint8_t* visible);
+
+struct IndexRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// One draw's inputs for meshlet culling, built once per model instance
+struct MeshletCullView {
+    const Frustum* frustum;     // world space
+    glm::mat4 modelMatrix;
+    glm::vec3 localCamera;      // camera position in model space
+    float scale;                // largest axis scale of modelMatrix
+    bool mirrored;              // negative determinant flips which side is the back
+    uint32_t tested = 0;
+    uint32_t culled = 0;
+
+    static MeshletCullView Make(const Frustum& frustum, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition);
+};
+
+// Appends the index ranges of the meshlets that survive, merging neighbours.
+// Back-facing clusters are only rejected when backFacesCulled, since with
+// face culling off their back sides are visible.
+void CullMeshlets(const std::vector<Meshlet>& meshlets, MeshletCullView& view, bool backFacesCulled, std::vector<IndexRange>& out);
@@ -0,0 +1,268 @@
+#include "GLState.h"
+
+static constexpr GLuint kUnknown = ~0u;
+static constexpr GLenum kUnknownEnum = ~0u;
+
+enum TextureTarget
+{
+    TEXTURE_TARGET_2D = 0,
+    TEXTURE_TARGET_CUBE_MAP = 1,
+    TEXTURE_TARGET_COUNT
+};
+
+enum BufferTarget
+{
+    BUFFER_TARGET_ARRAY = 0,
+    BUFFER_TARGET_UNIFORM,
+    BUFFER_TARGET_COPY_READ,
+    BUFFER_TARGET_COPY_WRITE,
+    BUFFER_TARGET_DRAW_INDIRECT,
+    BUFFER_TARGET_COUNT
+};
+
+static constexpr unsigned int kMaxUniformBindings = 16;
+
+struct StateCache
+{
+    GLuint program;
+    GLuint vertexArray;
+    GLuint buffers[BUFFER_TARGET_COUNT];
+    GLuint uniformBindings[kMaxUniformBindings];
+    GLenum activeTexture;
+    GLuint textures[GLState::kMaxTextureUnits][TEXTURE_TARGET_COUNT];
+
+    int depthTest;
+    int blend;
+    int cullFace;
+    GLenum depthFunc;
+    int depthMask;
+    int colorMask;
+    GLenum blendSrc, blendDst;
+
+    GLStateStats stats;
+};
+
+static StateCache s_State;
+static bool s_Initialized = false;
+
+static int TextureTargetIndex(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D: return TEXTURE_TARGET_2D;
+    case GL_TEXTURE_CUBE_MAP: return TEXTURE_TARGET_CUBE_MAP;
+    default: return -1;
+    }
+}
+
+// GL_ELEMENT_ARRAY_BUFFER is VAO state, so it is deliberately not cached here
+static int BufferTargetIndex(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER: return BUFFER_TARGET_ARRAY;
+    case GL_UNIFORM_BUFFER: return BUFFER_TARGET_UNIFORM;
+    case GL_COPY_READ_BUFFER: return BUFFER_TARGET_COPY_READ;
+    case GL_COPY_WRITE_BUFFER: return BUFFER_TARGET_COPY_WRITE;
+    case GL_DRAW_INDIRECT_BUFFER: return BUFFER_TARGET_DRAW_INDIRECT;
+    default: return -1;
+    }
+}
+
+static void EnsureInitialized()
+{
+    if (!s_Initialized) GLState::Invalidate();
+}
+
+// Returns true when the caller has to issue the GL call
+template <typename T>
+static bool Update(T& cached, T value)
+{
+    if (cached == value)
+    {
+        s_State.stats.skipped++;
+        return false;
+    }
+    cached = value;
+    s_State.stats.issued++;
+    return true;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+    EnsureInitialized();
+    if (Update(s_State.program, program)) glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+    EnsureInitialized();
+    if (Update(s_State.vertexArray, vao)) glBindVertexArray(vao);
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+    EnsureInitialized();
+    int index = BufferTargetIndex(target);
+    if (index < 0)
+    {
+        s_State.stats.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (Update(s_State.buffers[index], buffer)) glBindBuffer(target, buffer);
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    EnsureInitialized();
+    // Binding to an indexed point also binds the generic target
+    if (target == GL_UNIFORM_BUFFER && index < kMaxUniformBindings)
+    {
+        if (Update(s_State.uniformBindings[index], buffer))
+        {
+            glBindBufferBase(target, index, buffer);
+            s_State.buffers[BUFFER_TARGET_UNIFORM] = buffer;
+        }
+        return;
+    }
+    s_State.stats.issued++;
+    glBindBufferBase(target, index, buffer);
+    int generic = BufferTargetIndex(target);
+    if (generic >= 0) s_State.buffers[generic] = buffer;
+}
+
+void GLState::BindTexture(unsigned int unit, GLenum target, GLuint texture)
+{
+    EnsureInitialized();
+    int index = TextureTargetIndex(target);
+    if (unit >= kMaxTextureUnits || index < 0)
+    {
+        if (Update(s_State.activeTexture, GL_TEXTURE0 + unit)) glActiveTexture(GL_TEXTURE0 + unit);
+        s_State.stats.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (s_State.textures[unit][index] == texture)
+    {
+        s_State.stats.skipped++;
+        return;
+    }
+    if (Update(s_State.activeTexture, GL_TEXTURE0 + unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    Update(s_State.textures[unit][index], texture);
+    glBindTexture(target, texture);
+}
+
+void GLState::SetEnabled(GLenum capability, bool enabled)
+{
+    EnsureInitialized();
+    int* cached = nullptr;
+    switch (capability)
+    {
+    case GL_DEPTH_TEST: cached = &s_State.depthTest; break;
+    case GL_BLEND: cached = &s_State.blend; break;
+    case GL_CULL_FACE: cached = &s_State.cullFace; break;
+    default: break;
+    }
+    if (cached && !Update(*cached, enabled ? 1 : 0)) return;
+    if (!cached) s_State.stats.issued++;
+
+    if (enabled) glEnable(capability);
+    else glDisable(capability);
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+    EnsureInitialized();
+    if (Update(s_State.depthFunc, func)) glDepthFunc(func);
+}
+
+void GLState::DepthMask(GLboolean mask)
+{
+    EnsureInitialized();
+    if (Update(s_State.depthMask, mask ? 1 : 0)) glDepthMask(mask);
+}
+
+void GLState::ColorMask(GLboolean mask)
+{
+    EnsureInitialized();
+    if (Update(s_State.colorMask, mask ? 1 : 0)) glColorMask(mask, mask, mask, mask);
+}
+
+void GLState::BlendFunc(GLenum src, GLenum dst)
+{
+    EnsureInitialized();
+    if (s_State.blendSrc == src && s_State.blendDst == dst)
+    {
+        s_State.stats.skipped++;
+        return;
+    }
+    s_State.blendSrc = src;
+    s_State.blendDst = dst;
+    s_State.stats.issued++;
+    glBlendFunc(src, dst);
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+    if (s_State.program == program) s_State.program = kUnknown;
+    glDeleteProgram(program);
+}
+
+void GLState::DeleteVertexArray(GLuint vao)
+{
+    if (s_State.vertexArray == vao) s_State.vertexArray = kUnknown;
+    glDeleteVertexArrays(1, &vao);
+}
+
+void GLState::DeleteBuffer(GLuint buffer)
+{
+    for (GLuint& bound : s_State.buffers)
+        if (bound == buffer) bound = kUnknown;
+    for (GLuint& bound : s_State.uniformBindings)
+        if (bound == buffer) bound = kUnknown;
+    glDeleteBuffers(1, &buffer);
+}
+
+void GLState::DeleteTexture(GLuint texture)
+{
+    for (auto& unit : s_State.textures)
+        for (GLuint& bound : unit)
+            if (bound == texture) bound = kUnknown;
+    glDeleteTextures(1, &texture);
+}
+
+void GLState::Invalidate()
+{
+    GLStateStats stats = s_State.stats;
+
+    s_State.program = kUnknown;
+    s_State.vertexArray = kUnknown;
+    for (GLuint& b : s_State.buffers) b = kUnknown;
+    for (GLuint& b : s_State.uniformBindings) b = kUnknown;
+    s_State.activeTexture = kUnknownEnum;
+    for (auto& unit : s_State.textures)
+        for (GLuint& t : unit) t = kUnknown;
+
+    s_State.depthTest = -1;
+    s_State.blend = -1;
+    s_State.cullFace = -1;
+    s_State.depthFunc = kUnknownEnum;
+    s_State.depthMask = -1;
+    s_State.colorMask = -1;
+    s_State.blendSrc = kUnknownEnum;
+    s_State.blendDst = kUnknownEnum;
+
+    s_State.stats = stats;
+    s_Initialized = true;
+}
+
+void GLState::ResetFrameStats()
+{
+    s_State.stats = GLStateStats();
+}
+
+const GLStateStats& GLState::GetStats()
+{
+    return s_State.stats;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+
+struct GLStateStats {
+    uint32_t issued = 0;
+    uint32_t skipped = 0;
+};
+
+// Shadow copy of the GL bindings the utils classes touch. Every bind/state
+// change goes through here and is dropped when it would not change anything.
+// Code outside this layer that changes the same state must call Invalidate().
+class GLState {
+public:
+    static constexpr unsigned int kMaxTextureUnits = 16;
+
+    static void UseProgram(GLuint program);
+    static void BindVertexArray(GLuint vao);
+    static void BindBuffer(GLenum target, GLuint buffer);
+    static void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    // Selects the unit only if the binding actually has to change
+    static void BindTexture(unsigned int unit, GLenum target, GLuint texture);
+
+    static void SetEnabled(GLenum capability, bool enabled);
+    static void DepthFunc(GLenum func);
+    static void DepthMask(GLboolean mask);
+    // All four channels at once
+    static void ColorMask(GLboolean mask);
+    static void BlendFunc(GLenum src, GLenum dst);
+
+    // Deleting a bound object silently rebinds 0, and the name may be reused
+    static void DeleteProgram(GLuint program);
+    static void DeleteVertexArray(GLuint vao);
+    static void DeleteBuffer(GLuint buffer);
+    static void DeleteTexture(GLuint texture);
+
+    // Forget everything; the next call of each kind always reaches the driver
+    static void Invalidate();
+
+    static void ResetFrameStats();
+    static const GLStateStats& GetStats();
+};
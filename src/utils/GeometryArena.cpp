@@ -0,0 +1,427 @@
+#include "GeometryArena.h"
+#include "GeometryUploadQueue.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cstring>
+
+// Few layouts exist, so a linear scan beats hashing
+static std::vector<GeometryArena*> s_Arenas;
+static uint32_t s_Generation = 0;
+
+RangeAllocator::RangeAllocator(GLuint capacity)
+    : capacity(capacity)
+{
+    if (capacity > 0) freeRanges.push_back({0, capacity});
+}
+
+bool RangeAllocator::Allocate(GLuint size, GLuint& offset)
+{
+    for (size_t i = 0; i < freeRanges.size(); i++)
+    {
+        Range& range = freeRanges[i];
+        if (range.size < size) continue;
+
+        offset = range.offset;
+        range.offset += size;
+        range.size -= size;
+        if (range.size == 0) freeRanges.erase(freeRanges.begin() + i);
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::Free(GLuint offset, GLuint size)
+{
+    if (size == 0) return;
+
+    auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+        [](const Range& r, GLuint value) { return r.offset < value; });
+    it = freeRanges.insert(it, {offset, size});
+
+    // Merge with the following range, then with the preceding one
+    auto next = it + 1;
+    if (next != freeRanges.end() && it->offset + it->size == next->offset)
+    {
+        it->size += next->size;
+        freeRanges.erase(next);
+    }
+    if (it != freeRanges.begin())
+    {
+        auto prev = it - 1;
+        if (prev->offset + prev->size == it->offset)
+        {
+            prev->size += it->size;
+            freeRanges.erase(it);
+        }
+    }
+}
+
+void RangeAllocator::Grow(GLuint newCapacity)
+{
+    if (newCapacity <= capacity) return;
+    GLuint oldCapacity = capacity;
+    capacity = newCapacity;
+    Free(oldCapacity, newCapacity - oldCapacity);
+}
+
+GeometryArena* GeometryArena::Find(const VertexLayout& layout, GLenum indexType)
+{
+    for (GeometryArena* arena : s_Arenas)
+        if (&arena->layout == &layout && arena->indexType == indexType) return arena;
+    return nullptr;
+}
+
+GeometryArena& GeometryArena::Get(const VertexLayout& layout, GLenum indexType)
+{
+    if (GeometryArena* existing = Find(layout, indexType)) return *existing;
+
+    // 256K vertices is the aeroplane many times over; grows if needed
+    GeometryArena* arena = new GeometryArena(layout, indexType, 256 * 1024, 1024 * 1024);
+    s_Arenas.push_back(arena);
+    return *arena;
+}
+
+void GeometryArena::Shutdown()
+{
+    for (GeometryArena* arena : s_Arenas)
+        delete arena;
+    s_Arenas.clear();
+    s_Generation++;
+}
+
+uint32_t GeometryArena::Generation()
+{
+    return s_Generation;
+}
+
+struct GeometryOwner
+{
+    const VertexLayout* layout;
+    GeometryAllocation allocation;
+    uint32_t generation;
+    uint64_t upload = 0;
+    uint32_t refCount = 1;
+};
+
+GeometryHandle::GeometryHandle(const VertexLayout& layout, const GeometryAllocation& allocation)
+    : owner(new GeometryOwner{&layout, allocation, GeometryArena::Generation()}), allocation(allocation)
+{
+}
+
+GeometryHandle::~GeometryHandle()
+{
+    Reset();
+}
+
+GeometryHandle::GeometryHandle(const GeometryHandle& other)
+    : owner(other.owner), allocation(other.allocation)
+{
+    if (owner) owner->refCount++;
+}
+
+GeometryHandle::GeometryHandle(GeometryHandle&& other) noexcept
+    : owner(other.owner), allocation(other.allocation)
+{
+    other.owner = nullptr;
+    other.allocation = GeometryAllocation();
+}
+
+GeometryHandle& GeometryHandle::operator=(GeometryHandle other) noexcept
+{
+    std::swap(owner, other.owner);
+    std::swap(allocation, other.allocation);
+    return *this;
+}
+
+void GeometryHandle::SetUpload(uint64_t ticket)
+{
+    if (owner) owner->upload = ticket;
+}
+
+uint64_t GeometryHandle::Upload() const
+{
+    return owner ? owner->upload : 0;
+}
+
+bool GeometryHandle::Resident() const
+{
+    return allocation.Valid() && GeometryUploadQueue::IsComplete(owner->upload);
+}
+
+uint32_t GeometryHandle::UseCount() const
+{
+    return owner ? owner->refCount : 0;
+}
+
+void GeometryHandle::Reset()
+{
+    if (owner && --owner->refCount > 0)
+    {
+        // The upload may still be reading the arrays of the mesh letting go
+        GeometryUploadQueue::WaitStaged(owner->upload);
+    }
+    else if (owner)
+    {
+        // A copy issued after the range is handed out again would overwrite the new owner
+        GeometryUploadQueue::Cancel(owner->upload);
+        // The arena may already be gone if the renderer shut down first
+        const GeometryAllocation& range = owner->allocation;
+        if (range.Valid() && owner->generation == GeometryArena::Generation())
+        {
+            if (GeometryArena* arena = GeometryArena::Find(*owner->layout, range.indexType))
+                arena->Free(range);
+        }
+        delete owner;
+    }
+    owner = nullptr;
+    allocation = GeometryAllocation();
+}
+
+// Drops the position attribute and packs the rest back to back
+static VertexLayout AttributeStreamLayout(const VertexLayout& layout)
+{
+    VertexLayout packed;
+    for (unsigned int i = 0; i < layout.attributeCount; i++)
+    {
+        VertexAttribute a = layout.attributes[i];
+        if (a.location == VERTEX_LOCATION_POSITION) continue;
+        a.offset = packed.stride;
+        packed.stride += VertexAttributeSize(a);
+        packed.attributes[packed.attributeCount++] = a;
+    }
+    return packed;
+}
+
+GeometryArena::GeometryArena(const VertexLayout& layout, GLenum indexType, GLuint vertexCapacity, GLuint indexCapacity)
+    : layout(layout), attributeLayout(AttributeStreamLayout(layout)), indexType(indexType), vertexRanges(vertexCapacity), indexRanges(indexCapacity)
+{
+    glGenVertexArrays(1, &vao.id);
+    glGenVertexArrays(1, &depthVao.id);
+    glGenBuffers(1, &positionVbo);
+    glGenBuffers(1, &ebo);
+
+    GLState::BindBuffer(GL_ARRAY_BUFFER, positionVbo);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexCapacity) * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+    if (attributeLayout.stride > 0)
+    {
+        glGenBuffers(1, &attributeVbo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, attributeVbo);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexCapacity) * attributeLayout.stride, nullptr, GL_STATIC_DRAW);
+    }
+    // The EBO binding lives in the VAO
+    GLState::BindVertexArray(vao.id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexCapacity) * IndexTypeSize(indexType), nullptr, GL_STATIC_DRAW);
+
+    setupAttributes();
+}
+
+GeometryArena::~GeometryArena()
+{
+    GLState::DeleteVertexArray(vao.id);
+    GLState::DeleteVertexArray(depthVao.id);
+    GLState::DeleteBuffer(positionVbo);
+    if (attributeVbo) GLState::DeleteBuffer(attributeVbo);
+    GLState::DeleteBuffer(ebo);
+}
+
+void GeometryArena::setupAttributes()
+{
+    for (GLuint id : {vao.id, depthVao.id})
+    {
+        GLState::BindVertexArray(id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, positionVbo);
+        glEnableVertexAttribArray(VERTEX_LOCATION_POSITION);
+        glVertexAttribPointer(VERTEX_LOCATION_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    }
+
+    // Only the shading VAO sees the other attributes
+    if (!attributeVbo) return;
+    GLState::BindVertexArray(vao.id);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, attributeVbo);
+    const GLsizei stride = static_cast<GLsizei>(attributeLayout.stride);
+    for (unsigned int i = 0; i < attributeLayout.attributeCount; i++)
+    {
+        const VertexAttribute& a = attributeLayout.attributes[i];
+        glEnableVertexAttribArray(a.location);
+        if (a.integer)
+            glVertexAttribIPointer(a.location, a.components, a.type, stride, (void*)uintptr_t(a.offset));
+        else
+            glVertexAttribPointer(a.location, a.components, a.type, a.normalized, stride, (void*)uintptr_t(a.offset));
+    }
+}
+
+// Reallocates a buffer at least twice as large and copies the old contents over on the GPU
+static GLuint GrowBuffer(GLuint oldBuffer, GLsizeiptr oldBytes, GLsizeiptr newBytes)
+{
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    GLState::BindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+    GLState::BindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+    GLState::DeleteBuffer(oldBuffer);
+    return newBuffer;
+}
+
+void GeometryArena::growVertices(GLuint minCapacity)
+{
+    GLuint oldCapacity = vertexRanges.Capacity();
+    GLuint newCapacity = std::max(oldCapacity * 2, minCapacity);
+    positionVbo = GrowBuffer(positionVbo, GLsizeiptr(oldCapacity) * sizeof(glm::vec3), GLsizeiptr(newCapacity) * sizeof(glm::vec3));
+    if (attributeVbo)
+        attributeVbo = GrowBuffer(attributeVbo, GLsizeiptr(oldCapacity) * attributeLayout.stride, GLsizeiptr(newCapacity) * attributeLayout.stride);
+    vertexRanges.Grow(newCapacity);
+    setupAttributes();
+}
+
+void GeometryArena::growIndices(GLuint minCapacity)
+{
+    GLuint oldCapacity = indexRanges.Capacity();
+    GLuint newCapacity = std::max(oldCapacity * 2, minCapacity);
+    const GLuint indexSize = IndexTypeSize(indexType);
+    ebo = GrowBuffer(ebo, GLsizeiptr(oldCapacity) * indexSize, GLsizeiptr(newCapacity) * indexSize);
+    indexRanges.Grow(newCapacity);
+    setupAttributes();
+}
+
+GeometryAllocation GeometryArena::Allocate(GLuint vertexCount, GLuint indexCount)
+{
+    GeometryAllocation allocation;
+    if (vertexCount == 0) return allocation;
+
+    GLuint vertexOffset = 0, indexOffset = 0;
+    if (!vertexRanges.Allocate(vertexCount, vertexOffset))
+    {
+        growVertices(vertexRanges.Capacity() + vertexCount);
+        vertexRanges.Allocate(vertexCount, vertexOffset);
+    }
+    if (indexCount > 0 && !indexRanges.Allocate(indexCount, indexOffset))
+    {
+        growIndices(indexRanges.Capacity() + indexCount);
+        indexRanges.Allocate(indexCount, indexOffset);
+    }
+
+    allocation.baseVertex = static_cast<GLint>(vertexOffset);
+    allocation.vertexCount = vertexCount;
+    allocation.firstIndex = indexOffset;
+    allocation.indexCount = indexCount;
+    allocation.indexType = indexType;
+    return allocation;
+}
+
+void GeometryArena::PackAttributes(GLuint vertexCount, const void* vertexData, void* dst) const
+{
+    // Same attribute order in both layouts, so each one is a straight copy
+    const uint8_t* src = static_cast<const uint8_t*>(vertexData);
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    for (GLuint v = 0; v < vertexCount; v++, src += layout.stride, out += attributeLayout.stride)
+    {
+        for (unsigned int i = 0, j = 0; i < layout.attributeCount; i++)
+        {
+            const VertexAttribute& a = layout.attributes[i];
+            if (a.location == VERTEX_LOCATION_POSITION) continue;
+            const VertexAttribute& packed = attributeLayout.attributes[j++];
+            std::memcpy(out + packed.offset, src + a.offset, VertexAttributeSize(a));
+        }
+    }
+}
+
+void GeometryArena::PackIndices(GLuint indexCount, const unsigned int* indices, void* dst) const
+{
+    if (indexType == GL_UNSIGNED_SHORT)
+        std::copy(indices, indices + indexCount, static_cast<uint16_t*>(dst));
+    else
+        std::memcpy(dst, indices, size_t(indexCount) * sizeof(unsigned int));
+}
+
+void GeometryArena::Upload(const GeometryAllocation& allocation, const glm::vec3* positions, const void* vertexData, const unsigned int* indices)
+{
+    if (!allocation.Valid()) return;
+
+    GLState::BindBuffer(GL_ARRAY_BUFFER, positionVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(allocation.baseVertex) * sizeof(glm::vec3), PositionBytes(allocation), positions);
+
+    if (attributeVbo)
+    {
+        repackScratch.resize(size_t(AttributeBytes(allocation)));
+        PackAttributes(allocation.vertexCount, vertexData, repackScratch.data());
+        GLState::BindBuffer(GL_ARRAY_BUFFER, attributeVbo);
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(allocation.baseVertex) * attributeLayout.stride,
+                        AttributeBytes(allocation), repackScratch.data());
+    }
+
+    if (allocation.indexCount > 0)
+    {
+        const void* indexData = indices;
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            indexScratch.resize(size_t(IndexBytes(allocation)));
+            PackIndices(allocation.indexCount, indices, indexScratch.data());
+            indexData = indexScratch.data();
+        }
+
+        // The EBO binding lives in the VAO
+        GLState::BindVertexArray(vao.id);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(allocation.firstIndex) * IndexTypeSize(indexType),
+                        IndexBytes(allocation), indexData);
+    }
+}
+
+void GeometryArena::CopyFromStaging(const GeometryAllocation& allocation, GLuint stagingBuffer,
+                                    GLintptr positionOffset, GLintptr attributeOffset, GLintptr indexOffset)
+{
+    if (!allocation.Valid()) return;
+
+    // Looked up now rather than at enqueue time: the buffers may have grown since
+    GLState::BindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+    GLState::BindBuffer(GL_COPY_WRITE_BUFFER, positionVbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, positionOffset,
+                        GLintptr(allocation.baseVertex) * sizeof(glm::vec3), PositionBytes(allocation));
+    if (attributeVbo)
+    {
+        GLState::BindBuffer(GL_COPY_WRITE_BUFFER, attributeVbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, attributeOffset,
+                            GLintptr(allocation.baseVertex) * attributeLayout.stride, AttributeBytes(allocation));
+    }
+    if (allocation.indexCount > 0)
+    {
+        GLState::BindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, indexOffset,
+                            GLintptr(allocation.firstIndex) * IndexTypeSize(indexType), IndexBytes(allocation));
+    }
+}
+
+void GeometryArena::Free(const GeometryAllocation& allocation)
+{
+    if (!allocation.Valid()) return;
+    vertexRanges.Free(static_cast<GLuint>(allocation.baseVertex), allocation.vertexCount);
+    indexRanges.Free(allocation.firstIndex, allocation.indexCount);
+}
+
+void GeometryArena::BindInstanceStream(GLuint buffer, GLintptr byteOffset, bool depthOnly)
+{
+    VertexArray& array = vertexArray(depthOnly);
+    GLState::BindVertexArray(array.id);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, buffer);
+    // Instance model matrix, one column per location
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        glEnableVertexAttribArray(5 + i);
+        glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(byteOffset + i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(5 + i, 1);
+    }
+    array.instanceAttribsEnabled = true;
+}
+
+void GeometryArena::BindWithoutInstances(bool depthOnly)
+{
+    VertexArray& array = vertexArray(depthOnly);
+    GLState::BindVertexArray(array.id);
+    if (!array.instanceAttribsEnabled) return;
+
+    for (unsigned int i = 0; i < 4; i++)
+        glDisableVertexAttribArray(5 + i);
+    array.instanceAttribsEnabled = false;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+#include "RenderTypes.h"
+#include "VertexFormat.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+inline GLuint IndexTypeSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// Meshes index relative to their own vertices, so anything up to 65536
+// vertices fits 16-bit indices whatever its place in the arena
+inline GLenum ChooseIndexType(size_t vertexCount)
+{
+    return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// A mesh's slice of the shared vertex and index buffers. Indices are kept
+// relative to the mesh, so draws pass baseVertex.
+struct GeometryAllocation {
+    GLint  baseVertex = 0;
+    GLuint vertexCount = 0;
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    bool Valid() const { return vertexCount > 0; }
+    // Byte offset of the first index, as glDrawElements* expects it
+    const void* IndexOffset() const { return (const void*)(uintptr_t(firstIndex) * IndexTypeSize(indexType)); }
+};
+
+// First-fit free list over [0, capacity) with coalescing on free
+class RangeAllocator {
+public:
+    explicit RangeAllocator(GLuint capacity = 0);
+
+    // Returns false when no free range is large enough
+    bool Allocate(GLuint size, GLuint& offset);
+    void Free(GLuint offset, GLuint size);
+    // Adds [oldCapacity, newCapacity) to the free list
+    void Grow(GLuint newCapacity);
+
+    GLuint Capacity() const { return capacity; }
+
+private:
+    struct Range { GLuint offset, size; };
+    std::vector<Range> freeRanges;
+    GLuint capacity;
+};
+
+class GeometryArena;
+struct GeometryOwner;
+
+// Shared, refcounted ownership of a GeometryAllocation, so meshes with the
+// same vertices and indices draw from one range. The last handle to go
+// gives the range back to its arena. GL thread only.
+class GeometryHandle {
+public:
+    GeometryHandle() = default;
+    GeometryHandle(const VertexLayout& layout, const GeometryAllocation& allocation);
+    ~GeometryHandle();
+
+    GeometryHandle(const GeometryHandle& other);
+    GeometryHandle(GeometryHandle&& other) noexcept;
+    GeometryHandle& operator=(GeometryHandle other) noexcept;
+
+    const GeometryAllocation& operator*() const { return allocation; }
+    const GeometryAllocation* operator->() const { return &allocation; }
+
+    // Ticket of the GeometryUploadQueue upload filling this range; 0 once it was written directly
+    void SetUpload(uint64_t ticket);
+    uint64_t Upload() const;
+    // Valid and its upload has landed on the GPU, so it may be drawn
+    bool Resident() const;
+    // Handles sharing this range, this one included
+    uint32_t UseCount() const;
+    bool SharesWith(const GeometryHandle& other) const { return owner && owner == other.owner; }
+
+    // Drops this reference; the handle is empty afterwards. The last one
+    // frees the range and cancels a queued upload, the others wait until
+    // the upload no longer reads its source arrays.
+    void Reset();
+
+private:
+    GeometryOwner* owner = nullptr;
+    // Copy of owner's allocation, so draws read it without the indirection
+    GeometryAllocation allocation;
+};
+
+// Sub-allocates the vertices and indices of every Mesh with the same vertex
+// layout from shared buffers behind a single VAO, so switching meshes does
+// not switch VAOs and many meshes can go out in one multi-draw. Buffers
+// grow by copying on the GPU; allocations keep their offsets when that
+// happens.
+//
+// Positions live in their own tightly packed float3 stream, the remaining
+// attributes interleaved in a second one. The depth VAO reads positions
+// only, so a depth pre-pass fetches 12 bytes per vertex.
+class GeometryArena {
+public:
+    // One arena per vertex layout and index type, created on first use.
+    // Layouts are the static tables from VertexTraits/GetVertexLayout,
+    // compared by address. A multi-draw takes a single index type, so
+    // 16- and 32-bit meshes never share an index buffer.
+    static GeometryArena& Get(const VertexLayout& layout, GLenum indexType = GL_UNSIGNED_INT);
+    // Like Get, but never creates one; null after Shutdown
+    static GeometryArena* Find(const VertexLayout& layout, GLenum indexType);
+    // Deletes every arena. Handles still alive afterwards release nothing.
+    static void Shutdown();
+    // Bumped by Shutdown, so handles can tell an arena from a later one at the same address
+    static uint32_t Generation();
+
+    GeometryAllocation Allocate(GLuint vertexCount, GLuint indexCount);
+    // vertexData is laid out as this arena's VertexLayout; its position
+    // attribute is skipped, positions come from the separate array. Indices
+    // are narrowed to the arena's index type on the way.
+    void Upload(const GeometryAllocation& allocation, const glm::vec3* positions, const void* vertexData, const unsigned int* indices);
+    void Free(const GeometryAllocation& allocation);
+
+    // The pieces of Upload, for the staged path (GeometryUploadQueue).
+    // Bytes each stream of an allocation takes in this arena's buffers
+    GLsizeiptr PositionBytes(const GeometryAllocation& allocation) const { return GLsizeiptr(allocation.vertexCount) * sizeof(glm::vec3); }
+    GLsizeiptr AttributeBytes(const GeometryAllocation& allocation) const { return GLsizeiptr(allocation.vertexCount) * attributeLayout.stride; }
+    GLsizeiptr IndexBytes(const GeometryAllocation& allocation) const { return GLsizeiptr(allocation.indexCount) * IndexTypeSize(indexType); }
+    // Convert to the stored formats; no GL calls and no shared scratch, so worker threads may call them
+    void PackAttributes(GLuint vertexCount, const void* vertexData, void* dst) const;
+    void PackIndices(GLuint indexCount, const unsigned int* indices, void* dst) const;
+    // Copies an allocation's streams out of a staging buffer at the given byte offsets
+    void CopyFromStaging(const GeometryAllocation& allocation, GLuint stagingBuffer,
+                         GLintptr positionOffset, GLintptr attributeOffset, GLintptr indexOffset);
+
+    GLuint VAO() const { return vao.id; }
+    GLuint DepthVAO() const { return depthVao.id; }
+    GLenum IndexType() const { return indexType; }
+
+    // Binds the VAO (or the position-only depth VAO) and points attribute
+    // locations 5-8 (per-instance model matrix) at buffer + byteOffset
+    void BindInstanceStream(GLuint buffer, GLintptr byteOffset, bool depthOnly = false);
+    // Binds the VAO with the instance attributes disabled, so shaders see the constant value
+    void BindWithoutInstances(bool depthOnly = false);
+
+private:
+    GeometryArena(const VertexLayout& layout, GLenum indexType, GLuint vertexCapacity, GLuint indexCapacity);
+    ~GeometryArena();
+
+    struct VertexArray
+    {
+        GLuint id = 0;
+        bool instanceAttribsEnabled = false;
+    };
+
+    const VertexLayout& layout;
+    // layout without the position, packed; stride 0 if position is all there is
+    VertexLayout attributeLayout;
+    GLenum indexType;
+    VertexArray vao, depthVao;
+    GLuint positionVbo = 0, attributeVbo = 0, ebo = 0;
+    RangeAllocator vertexRanges, indexRanges;
+    std::vector<uint8_t> repackScratch;
+    std::vector<uint8_t> indexScratch;
+
+    void setupAttributes();
+    VertexArray& vertexArray(bool depthOnly) { return depthOnly ? depthVao : vao; }
+    void growVertices(GLuint minCapacity);
+    void growIndices(GLuint minCapacity);
+};
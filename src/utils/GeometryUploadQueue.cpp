@@ -0,0 +1,356 @@
+#include "GeometryUploadQueue.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Holds the aeroplane several times over; anything larger uploads synchronously
+static constexpr GLsizeiptr kStagingSize = 32 * 1024 * 1024;
+static constexpr GLsizeiptr kDefaultFrameBudget = 4 * 1024 * 1024;
+static constexpr unsigned int kWorkerCount = 2;
+// Keeps every stream's offset aligned for its element type
+static constexpr GLsizeiptr kStagingAlignment = 16;
+
+enum class UploadState { Queued, Packing, Staged, Issued };
+
+struct UploadJob
+{
+    uint64_t ticket;
+    GeometryArena* arena;
+    GeometryAllocation allocation;
+    const glm::vec3* positions;
+    const void* vertexData;
+    const unsigned int* indices;
+    // Byte range in the staging ring; positions start at offset
+    GLintptr offset;
+    GLsizeiptr size;
+    GLintptr attributeOffset, indexOffset;
+    UploadState state = UploadState::Queued;
+    bool cancelled = false;
+};
+
+struct UploadFence
+{
+    GLsync sync;
+    uint64_t lastTicket;
+};
+
+struct UploadQueueData
+{
+    bool initialized = false;
+    bool persistent = false;
+    GLuint staging = 0;
+    unsigned char* mapped = nullptr;
+
+    // Live jobs occupy the ring in ticket order from tail to head
+    GLintptr head = 0, tail = 0;
+    bool wrapped = false;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable, jobStaged;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    // Front is the oldest upload not yet complete. A deque keeps references
+    // stable while the ends change, so workers can pack a job outside the lock.
+    std::deque<UploadJob> jobs;
+    std::deque<UploadFence> fences;
+    uint64_t nextTicket = 1;
+    uint64_t nextToPack = 1;
+    uint64_t nextToIssue = 1;
+    // Every ticket up to this one is on the GPU
+    uint64_t completed = 0;
+
+    GLsizeiptr frameBudget = kDefaultFrameBudget;
+    GeometryUploadStats stats;
+};
+
+static UploadQueueData s_Queue;
+
+static GLsizeiptr AlignUp(GLsizeiptr value)
+{
+    return (value + kStagingAlignment - 1) / kStagingAlignment * kStagingAlignment;
+}
+
+// Caller holds the mutex
+static UploadJob* FindJob(uint64_t ticket)
+{
+    if (ticket == 0 || s_Queue.jobs.empty()) return nullptr;
+    uint64_t first = s_Queue.jobs.front().ticket;
+    if (ticket < first || ticket - first >= s_Queue.jobs.size()) return nullptr;
+    return &s_Queue.jobs[size_t(ticket - first)];
+}
+
+// Runs on a worker; the profiler is GL-thread only
+static void PackJob(const UploadJob& job)
+{
+    const GeometryAllocation& allocation = job.allocation;
+    std::memcpy(s_Queue.mapped + job.offset, job.positions, size_t(job.arena->PositionBytes(allocation)));
+    if (job.arena->AttributeBytes(allocation) > 0)
+        job.arena->PackAttributes(allocation.vertexCount, job.vertexData, s_Queue.mapped + job.attributeOffset);
+    if (allocation.indexCount > 0)
+        job.arena->PackIndices(allocation.indexCount, job.indices, s_Queue.mapped + job.indexOffset);
+}
+
+static void WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(s_Queue.mutex);
+    while (true)
+    {
+        s_Queue.workAvailable.wait(lock, [] { return s_Queue.stopping || s_Queue.nextToPack < s_Queue.nextTicket; });
+        if (s_Queue.stopping) return;
+
+        UploadJob* job = FindJob(s_Queue.nextToPack++);
+        // Cancelled before any worker got to it
+        if (!job || job->state != UploadState::Queued) continue;
+
+        job->state = UploadState::Packing;
+        lock.unlock();
+        PackJob(*job);
+        lock.lock();
+        job->state = UploadState::Staged;
+        s_Queue.jobStaged.notify_all();
+    }
+}
+
+static void Init()
+{
+    s_Queue.initialized = true;
+    s_Queue.persistent = (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) && glBufferStorage != nullptr;
+    if (!s_Queue.persistent) return;
+
+    glGenBuffers(1, &s_Queue.staging);
+    GLState::BindBuffer(GL_COPY_READ_BUFFER, s_Queue.staging);
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_COPY_READ_BUFFER, kStagingSize, nullptr, flags);
+    s_Queue.mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, kStagingSize, flags));
+    if (!s_Queue.mapped)
+    {
+        std::cout << "ERROR::UPLOAD_QUEUE::PERSISTENT_MAP_FAILED" << std::endl;
+        GLState::DeleteBuffer(s_Queue.staging);
+        s_Queue.staging = 0;
+        s_Queue.persistent = false;
+        return;
+    }
+
+    s_Queue.stopping = false;
+    for (unsigned int i = 0; i < kWorkerCount; i++)
+        s_Queue.workers.emplace_back(WorkerLoop);
+}
+
+// Retires uploads whose fence has signalled. With block, waits for the oldest
+// fence first. Caller holds the mutex.
+static void RetireFences(bool block)
+{
+    while (!s_Queue.fences.empty())
+    {
+        UploadFence& fence = s_Queue.fences.front();
+        GLenum result = glClientWaitSync(fence.sync, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? 1000000 : 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            if (block) continue;
+            break;
+        }
+        block = false;
+        glDeleteSync(fence.sync);
+        s_Queue.completed = fence.lastTicket;
+
+        while (!s_Queue.jobs.empty() && s_Queue.jobs.front().ticket <= fence.lastTicket)
+        {
+            const UploadJob& job = s_Queue.jobs.front();
+            // The first job after a wrap starts below the tail
+            if (job.offset < s_Queue.tail) s_Queue.wrapped = false;
+            s_Queue.tail = job.offset + job.size;
+            s_Queue.jobs.pop_front();
+        }
+        s_Queue.fences.pop_front();
+    }
+}
+
+// Issues staged uploads in ticket order until budget bytes have been copied.
+// Stops at the first one still being packed, unless wait. Caller holds the mutex.
+static GLsizeiptr IssueCopies(std::unique_lock<std::mutex>& lock, GLsizeiptr budget, bool wait)
+{
+    GLsizeiptr issued = 0;
+    uint64_t lastTicket = 0;
+    while (s_Queue.nextToIssue < s_Queue.nextTicket)
+    {
+        UploadJob& job = *FindJob(s_Queue.nextToIssue);
+        if (wait) s_Queue.jobStaged.wait(lock, [&] { return job.state == UploadState::Staged; });
+        if (job.state != UploadState::Staged) break;
+
+        if (!job.cancelled)
+        {
+            if (issued > 0 && issued + job.size > budget) break;
+            job.arena->CopyFromStaging(job.allocation, s_Queue.staging, job.offset, job.attributeOffset, job.indexOffset);
+            issued += job.size;
+        }
+        job.state = UploadState::Issued;
+        lastTicket = job.ticket;
+        s_Queue.nextToIssue++;
+    }
+    if (lastTicket) s_Queue.fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), lastTicket});
+    return issued;
+}
+
+// Finds size contiguous bytes in the ring, issuing and waiting for older
+// uploads when it is full. Caller holds the mutex.
+static bool ReserveStaging(std::unique_lock<std::mutex>& lock, GLsizeiptr size, GLintptr& offset)
+{
+    if (size > kStagingSize) return false;
+    while (true)
+    {
+        if (s_Queue.jobs.empty())
+        {
+            s_Queue.head = s_Queue.tail = 0;
+            s_Queue.wrapped = false;
+        }
+        if (!s_Queue.wrapped && s_Queue.head + size <= kStagingSize)
+        {
+            offset = s_Queue.head;
+            break;
+        }
+        if (!s_Queue.wrapped && size <= s_Queue.tail)
+        {
+            offset = 0;
+            s_Queue.wrapped = true;
+            break;
+        }
+        if (s_Queue.wrapped && s_Queue.head + size <= s_Queue.tail)
+        {
+            offset = s_Queue.head;
+            break;
+        }
+
+        // Full: this is the stall the budget normally avoids, so it only
+        // happens when one load queues more than the ring holds
+        PROFILE_CPU_SCOPE("GeometryUploadQueue::WaitForStaging");
+        if (s_Queue.fences.empty()) IssueCopies(lock, kStagingSize, true);
+        RetireFences(true);
+    }
+    s_Queue.head = offset + size;
+    return true;
+}
+
+uint64_t GeometryUploadQueue::Enqueue(GeometryArena& arena, const GeometryAllocation& allocation,
+                                      const glm::vec3* positions, const void* vertexData, const unsigned int* indices)
+{
+    if (!allocation.Valid()) return 0;
+    if (!s_Queue.initialized) Init();
+
+    const GLsizeiptr positionBytes = AlignUp(arena.PositionBytes(allocation));
+    const GLsizeiptr attributeBytes = AlignUp(arena.AttributeBytes(allocation));
+    const GLsizeiptr size = positionBytes + attributeBytes + AlignUp(arena.IndexBytes(allocation));
+
+    std::unique_lock<std::mutex> lock(s_Queue.mutex);
+    GLintptr offset = 0;
+    if (!s_Queue.persistent || !ReserveStaging(lock, size, offset))
+    {
+        lock.unlock();
+        arena.Upload(allocation, positions, vertexData, indices);
+        return 0;
+    }
+
+    UploadJob job;
+    job.ticket = s_Queue.nextTicket++;
+    job.arena = &arena;
+    job.allocation = allocation;
+    job.positions = positions;
+    job.vertexData = vertexData;
+    job.indices = indices;
+    job.offset = offset;
+    job.size = size;
+    job.attributeOffset = offset + positionBytes;
+    job.indexOffset = offset + positionBytes + attributeBytes;
+    s_Queue.jobs.push_back(job);
+    s_Queue.workAvailable.notify_one();
+    return job.ticket;
+}
+
+void GeometryUploadQueue::Process()
+{
+    if (!s_Queue.persistent) return;
+    PROFILE_CPU_SCOPE("GeometryUploadQueue::Process");
+
+    std::unique_lock<std::mutex> lock(s_Queue.mutex);
+    RetireFences(false);
+    s_Queue.stats.bytesCopied = IssueCopies(lock, s_Queue.frameBudget, false);
+    s_Queue.stats.pending = static_cast<uint32_t>(s_Queue.nextTicket - 1 - s_Queue.completed);
+}
+
+bool GeometryUploadQueue::IsComplete(uint64_t ticket)
+{
+    return ticket <= s_Queue.completed;
+}
+
+void GeometryUploadQueue::WaitStaged(uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(s_Queue.mutex);
+    UploadJob* job = FindJob(ticket);
+    if (!job) return;
+    // A queued job may be waiting for a worker still busy with an older one
+    s_Queue.jobStaged.wait(lock, [&] { return job->state == UploadState::Staged || job->state == UploadState::Issued; });
+}
+
+void GeometryUploadQueue::Cancel(uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(s_Queue.mutex);
+    UploadJob* job = FindJob(ticket);
+    if (!job) return;
+    // A worker may be reading the source arrays right now
+    s_Queue.jobStaged.wait(lock, [&] { return job->state != UploadState::Packing; });
+    job->cancelled = true;
+    if (job->state == UploadState::Queued) job->state = UploadState::Staged;
+}
+
+void GeometryUploadQueue::SetFrameBudget(GLsizeiptr bytes)
+{
+    s_Queue.frameBudget = bytes;
+}
+
+GeometryUploadStats GeometryUploadQueue::GetStats()
+{
+    return s_Queue.stats;
+}
+
+void GeometryUploadQueue::Shutdown()
+{
+    if (!s_Queue.initialized) return;
+
+    {
+        std::lock_guard<std::mutex> lock(s_Queue.mutex);
+        s_Queue.stopping = true;
+    }
+    s_Queue.workAvailable.notify_all();
+    for (std::thread& worker : s_Queue.workers)
+        worker.join();
+    s_Queue.workers.clear();
+
+    std::lock_guard<std::mutex> lock(s_Queue.mutex);
+    // Copies already issued read the staging buffer; let them finish first.
+    // Unissued uploads are dropped, their arenas are about to go as well.
+    while (!s_Queue.fences.empty())
+        RetireFences(true);
+    s_Queue.jobs.clear();
+    s_Queue.completed = s_Queue.nextTicket - 1;
+    s_Queue.nextToPack = s_Queue.nextToIssue = s_Queue.nextTicket;
+    s_Queue.head = s_Queue.tail = 0;
+    s_Queue.wrapped = false;
+    s_Queue.stats = GeometryUploadStats();
+
+    if (s_Queue.staging)
+    {
+        GLState::BindBuffer(GL_COPY_READ_BUFFER, s_Queue.staging);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        GLState::DeleteBuffer(s_Queue.staging);
+    }
+    s_Queue.staging = 0;
+    s_Queue.mapped = nullptr;
+    s_Queue.initialized = false;
+    s_Queue.persistent = false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#include "GeometryArena.h"
+
+struct GeometryUploadStats {
+    // Uploads queued or in flight, not yet drawable
+    uint32_t pending = 0;
+    // Bytes handed to glCopyBufferSubData by the last Process
+    GLsizeiptr bytesCopied = 0;
+};
+
+// Streams mesh geometry into the GeometryArenas without stalling the frame.
+//
+// Enqueue reserves space in a persistently mapped staging ring and returns
+// at once; worker threads pack positions, attributes and indices into it.
+// Process, once per frame on the GL thread, copies staged uploads into the
+// arena buffers with glCopyBufferSubData up to a byte budget and fences
+// them. An upload's ticket is complete once that fence has signalled.
+//
+// Without buffer storage (GL < 4.4 and no ARB_buffer_storage) Enqueue uploads synchronously and
+// returns 0, which always counts as complete.
+//
+// The source arrays must stay alive until the data is staged: WaitStaged
+// before freeing them, or Cancel. GeometryHandle and Mesh do both.
+class GeometryUploadQueue {
+public:
+    static void Shutdown();
+
+    // GL thread. Creates the staging ring and workers on first use.
+    static uint64_t Enqueue(GeometryArena& arena, const GeometryAllocation& allocation,
+                            const glm::vec3* positions, const void* vertexData, const unsigned int* indices);
+    // GL thread, once per frame: retires signalled uploads and issues new copies
+    static void Process();
+
+    static bool IsComplete(uint64_t ticket);
+    // Blocks until the ticket's source data has been copied into staging
+    static void WaitStaged(uint64_t ticket);
+    // Drops an upload whose range is being freed; a copy already issued still lands
+    static void Cancel(uint64_t ticket);
+
+    // Bytes copied per Process; one upload larger than this still goes through alone
+    static void SetFrameBudget(GLsizeiptr bytes);
+    static GeometryUploadStats GetStats();
+};
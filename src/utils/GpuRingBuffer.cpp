@@ -0,0 +1,166 @@
+#include "GpuRingBuffer.h"
+#include "GLState.h"
+#include <algorithm>
+#include <iostream>
+
+static GLsizeiptr AlignUp(GLsizeiptr value, GLsizeiptr alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+GpuRingBuffer::GpuRingBuffer(GLenum target, GLsizeiptr frameSize, unsigned int frameCount)
+    : target(target), frameSize(frameSize), frameCount(std::clamp(frameCount, 1u, 4u))
+{
+    persistent = (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) && glBufferStorage != nullptr;
+    create();
+}
+
+GpuRingBuffer::~GpuRingBuffer()
+{
+    destroy();
+}
+
+void GpuRingBuffer::create()
+{
+    glGenBuffers(1, &buffer);
+    GLState::BindBuffer(target, buffer);
+
+    GLsizeiptr capacity = frameSize * frameCount;
+    if (persistent)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, capacity, nullptr, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(target, 0, capacity, flags));
+        if (!mapped)
+            std::cout << "ERROR::RING_BUFFER::PERSISTENT_MAP_FAILED" << std::endl;
+    }
+    else
+    {
+        glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+    }
+
+    section = 0;
+    sectionHead = 0;
+    head = 0;
+    window = nullptr;
+}
+
+void GpuRingBuffer::destroy()
+{
+    for (unsigned int i = 0; i < frameCount; i++)
+        waitFence(i);
+
+    if (buffer)
+    {
+        GLState::BindBuffer(target, buffer);
+        if (mapped || window) glUnmapBuffer(target);
+        GLState::DeleteBuffer(buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+    window = nullptr;
+}
+
+void GpuRingBuffer::waitFence(unsigned int index)
+{
+    GLsync& fence = fences[index];
+    if (!fence) return;
+
+    GLbitfield flags = 0;
+    while (true)
+    {
+        GLenum result = glClientWaitSync(fence, flags, 1000000);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) break;
+        // Make sure the fence is actually submitted before waiting on it again
+        flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void GpuRingBuffer::BeginFrame()
+{
+    if (!persistent) return;
+
+    section = (section + 1) % frameCount;
+    sectionHead = 0;
+    // Normally long signalled: the GPU finished this section frameCount-1 frames ago
+    waitFence(section);
+}
+
+RingAllocation GpuRingBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+    RingAllocation allocation;
+    if (size <= 0 || size > frameSize) return allocation;
+
+    if (persistent)
+    {
+        if (!mapped) return allocation;
+        GLsizeiptr offset = AlignUp(sectionHead, alignment);
+        if (offset + size > frameSize) return allocation;
+        sectionHead = offset + size;
+
+        allocation.offset = section * frameSize + offset;
+        allocation.ptr = mapped + allocation.offset;
+        allocation.size = size;
+        return allocation;
+    }
+
+    GLsizeiptr capacity = frameSize * frameCount;
+    GLsizeiptr offset = AlignUp(head, alignment);
+    if (offset + size > capacity)
+    {
+        // Wrapped: orphan so the GPU keeps reading the old storage while we write fresh memory
+        Commit();
+        GLState::BindBuffer(target, buffer);
+        glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+        offset = 0;
+    }
+
+    if (!window)
+    {
+        // Everything past head is untouched since the last orphan, so no sync is needed
+        GLState::BindBuffer(target, buffer);
+        mapOffset = offset;
+        window = static_cast<unsigned char*>(glMapBufferRange(target, mapOffset, capacity - mapOffset,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+        if (!window) return allocation;
+    }
+
+    head = offset + size;
+    allocation.offset = offset;
+    allocation.ptr = window + (offset - mapOffset);
+    allocation.size = size;
+    return allocation;
+}
+
+void GpuRingBuffer::Commit()
+{
+    // Coherent persistent memory needs nothing; a draw cannot read a mapped buffer otherwise
+    if (persistent || !window) return;
+
+    GLState::BindBuffer(target, buffer);
+    glFlushMappedBufferRange(target, 0, head - mapOffset);
+    glUnmapBuffer(target);
+    window = nullptr;
+}
+
+void GpuRingBuffer::EndFrame()
+{
+    if (!persistent)
+    {
+        Commit();
+        return;
+    }
+    fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GpuRingBuffer::Reserve(GLsizeiptr newFrameSize)
+{
+    if (newFrameSize <= frameSize) return;
+
+    destroy();
+    frameSize = newFrameSize;
+    create();
+    if (persistent) sectionHead = 0;
+}
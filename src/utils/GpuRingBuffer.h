@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+struct RingAllocation {
+    void* ptr = nullptr;
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+
+    explicit operator bool() const { return ptr != nullptr; }
+};
+
+// Streaming buffer for data rewritten every frame (instance data, debug
+// lines, per-draw constants).
+//
+// GL 4.4+ or ARB_buffer_storage: one immutable buffer persistently mapped for its whole lifetime,
+// split into frameCount sections. A fence is placed after each frame and
+// waited on before that section is written again, so writes never stall on
+// the driver and never race the GPU.
+//
+// Otherwise (main.cpp asks for 3.3, which may lack the extension): allocations are appended to a
+// single buffer mapped with GL_MAP_UNSYNCHRONIZED_BIT, and the buffer is
+// orphaned when it wraps so the driver hands back fresh storage.
+//
+// Usage per frame: BeginFrame, Allocate and write, Commit before issuing
+// draws that read the data, EndFrame after the last of them.
+class GpuRingBuffer {
+public:
+    GpuRingBuffer(GLenum target, GLsizeiptr frameSize, unsigned int frameCount = 3);
+    ~GpuRingBuffer();
+
+    GpuRingBuffer(const GpuRingBuffer&) = delete;
+    GpuRingBuffer& operator=(const GpuRingBuffer&) = delete;
+
+    void BeginFrame();
+    // Returns an empty allocation if this frame's section is full
+    RingAllocation Allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+    // Makes everything allocated so far visible to the GPU
+    void Commit();
+    void EndFrame();
+
+    // Waits for the GPU and reallocates; only valid before the first Allocate of a frame
+    void Reserve(GLsizeiptr frameSize);
+
+    GLuint Buffer() const { return buffer; }
+    GLsizeiptr FrameSize() const { return frameSize; }
+    bool IsPersistent() const { return persistent; }
+
+private:
+    GLenum target;
+    GLuint buffer = 0;
+    GLsizeiptr frameSize;
+    unsigned int frameCount;
+    bool persistent;
+
+    // Persistent path
+    unsigned char* mapped = nullptr;
+    GLsync fences[4] = {};
+    unsigned int section = 0;
+    GLsizeiptr sectionHead = 0;
+
+    // Orphaning path
+    GLsizeiptr head = 0;
+    GLintptr mapOffset = 0;
+    unsigned char* window = nullptr;
+
+    void create();
+    void destroy();
+    void waitFence(unsigned int index);
+};
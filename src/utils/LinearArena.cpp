@@ -0,0 +1,51 @@
+#include "LinearArena.h"
+#include <algorithm>
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+LinearArena::LinearArena(size_t capacity)
+    : block(new uint8_t[capacity]), capacity(capacity)
+{
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+    size_t offset = AlignUp(base + used, alignment) - base;
+    if (offset + size <= capacity)
+    {
+        used = offset + size;
+        return block.get() + offset;
+    }
+
+    // Out of room this frame: serve from an overflow chunk and remember how much we needed
+    if (overflow.empty() || AlignUp(overflowOffset, alignment) + size > overflowSize)
+    {
+        overflowSize = std::max(capacity, size + alignment);
+        overflow.emplace_back(new uint8_t[overflowSize]);
+        overflowOffset = 0;
+    }
+    uintptr_t chunk = reinterpret_cast<uintptr_t>(overflow.back().get());
+    overflowOffset = AlignUp(chunk + overflowOffset, alignment) - chunk;
+    void* ptr = overflow.back().get() + overflowOffset;
+    overflowOffset += size;
+    overflowUsed += size + alignment;
+    return ptr;
+}
+
+void LinearArena::Reset()
+{
+    if (!overflow.empty())
+    {
+        capacity = AlignUp(used + overflowUsed, 4096);
+        block.reset(new uint8_t[capacity]);
+        overflow.clear();
+        overflowUsed = 0;
+        overflowOffset = 0;
+        overflowSize = 0;
+    }
+    used = 0;
+}
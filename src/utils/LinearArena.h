@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for data that lives exactly one frame. Nothing is freed
+// individually; Reset() rewinds the whole arena. If a frame overflows the
+// block, the extra memory comes from overflow chunks and the block is grown
+// to the high-water mark on the next Reset(), so steady-state frames never
+// touch the heap.
+class LinearArena
+{
+public:
+    explicit LinearArena(size_t capacity = 64 * 1024);
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Objects are never destroyed, so only trivially destructible types are allowed
+    template <typename T, typename... Args>
+    T* New(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "LinearArena does not run destructors");
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void Reset();
+
+    size_t Used() const { return used + overflowUsed; }
+    size_t Capacity() const { return capacity; }
+
+private:
+    std::unique_ptr<uint8_t[]> block;
+    size_t capacity;
+    size_t used = 0;
+
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t overflowUsed = 0;
+    size_t overflowOffset = 0;
+    size_t overflowSize = 0;
+};
@@ -1,70 +1,234 @@
 #include "Mesh.h"
+#include "GLState.h"
+#include "GeometryUploadQueue.h"
+#include <algorithm>
+#include <cmath>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, GLenum drawMode)
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, GLenum drawMode,
+           std::vector<MeshLod> lods, std::vector<Meshlet> meshlets, uint32_t vertexStreams)
+    : indices(std::move(indices)), textures(std::move(textures)), lods(std::move(lods)), meshlets(std::move(meshlets)), drawMode(drawMode)
 {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
-    this->drawMode = drawMode;
 
+    const uint32_t format = ChooseVertexFormat(vertices.data(), vertices.size(), vertexStreams);
+    layout = &GetVertexLayout(format);
+    vertexData.resize(vertices.size() * layout->stride);
+    EncodeVertices(format, vertices.data(), vertices.size(), vertexData.data());
+    positions.reserve(vertices.size());
+    for (const Vertex& v : vertices)
+        positions.push_back(v.Position);
+
+    computeBounds();
     setupMesh();
 }
 
-void Mesh::Draw(Shader &shader)
+Mesh::~Mesh()
+{
+    // Before the arrays go: a queued upload may still read them
+    geometry.Reset();
+}
+
+void Mesh::ReleaseCpuData()
+{
+    GeometryUploadQueue::WaitStaged(geometry.Upload());
+    // swap rather than clear() so the capacity goes too
+    std::vector<uint8_t>().swap(vertexData);
+    std::vector<glm::vec3>().swap(positions);
+    std::vector<unsigned int>().swap(indices);
+}
+
+void Mesh::computeBounds()
+{
+    bounds = AABB();
+    for (const glm::vec3& p : positions)
+        bounds.Expand(p);
+
+    boundingSphere = BoundingSphere();
+    if (!bounds.Valid()) return;
+
+    // Centered on the box, but sized to the farthest vertex rather than the box corner
+    boundingSphere.center = bounds.Center();
+    float radiusSq = 0.0f;
+    for (const glm::vec3& p : positions)
+    {
+        glm::vec3 d = p - boundingSphere.center;
+        radiusSq = std::max(radiusSq, glm::dot(d, d));
+    }
+    boundingSphere.radius = std::sqrt(radiusSq);
+}
+
+void Mesh::Draw(Shader &shader, unsigned int lod)
+{
+    if (!geometry.Resident()) return;
+    BindTextures(shader);
+
+    const MeshLod& range = Lod(lod);
+    ApplyFaceCulling();
+    Arena().BindWithoutInstances();
+    glDrawElementsBaseVertex(this->drawMode, range.indexCount, geometry->indexType, lodIndexOffset(range), geometry->baseVertex);
+}
+
+void Mesh::DrawInstanced(Shader &shader, unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod)
+{
+    if (!geometry.Resident()) return;
+    BindTextures(shader);
+
+    const MeshLod& range = Lod(lod);
+    ApplyFaceCulling();
+    Arena().BindInstanceStream(instanceBuffer, byteOffset);
+    glDrawElementsInstancedBaseVertex(this->drawMode, range.indexCount, geometry->indexType, lodIndexOffset(range), instanceCount, geometry->baseVertex);
+}
+
+void Mesh::DrawDepth(unsigned int lod)
+{
+    if (!geometry.Resident()) return;
+
+    const MeshLod& range = Lod(lod);
+    ApplyFaceCulling();
+    Arena().BindWithoutInstances(true);
+    glDrawElementsBaseVertex(this->drawMode, range.indexCount, geometry->indexType, lodIndexOffset(range), geometry->baseVertex);
+}
+
+void Mesh::DrawDepthInstanced(unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod)
+{
+    if (!geometry.Resident()) return;
+
+    const MeshLod& range = Lod(lod);
+    ApplyFaceCulling();
+    Arena().BindInstanceStream(instanceBuffer, byteOffset, true);
+    glDrawElementsInstancedBaseVertex(this->drawMode, range.indexCount, geometry->indexType, lodIndexOffset(range), instanceCount, geometry->baseVertex);
+}
+
+void Mesh::DrawRanges(Shader &shader, const std::vector<IndexRange>& ranges)
+{
+    if (!geometry.Resident() || ranges.empty()) return;
+    BindTextures(shader);
+
+    ApplyFaceCulling();
+    Arena().BindWithoutInstances();
+    multiDrawRanges(ranges);
+}
+
+void Mesh::DrawDepthRanges(const std::vector<IndexRange>& ranges)
+{
+    if (!geometry.Resident() || ranges.empty()) return;
+
+    ApplyFaceCulling();
+    Arena().BindWithoutInstances(true);
+    multiDrawRanges(ranges);
+}
+
+void Mesh::multiDrawRanges(const std::vector<IndexRange>& ranges)
+{
+    // Render thread only; kept so steady-state frames do not allocate
+    static std::vector<GLsizei> counts;
+    static std::vector<const void*> offsets;
+    static std::vector<GLint> baseVertices;
+    counts.clear();
+    offsets.clear();
+    for (const IndexRange& range : ranges)
+    {
+        counts.push_back(static_cast<GLsizei>(range.indexCount));
+        offsets.push_back((const void*)(uintptr_t(geometry->firstIndex + range.firstIndex) * IndexTypeSize(geometry->indexType)));
+    }
+    baseVertices.assign(ranges.size(), geometry->baseVertex);
+    glMultiDrawElementsBaseVertex(this->drawMode, counts.data(), geometry->indexType, offsets.data(),
+                                  static_cast<GLsizei>(ranges.size()), baseVertices.data());
+}
+
+void Mesh::ApplyFaceCulling() const
+{
+    GLState::SetEnabled(GL_CULL_FACE, !doubleSided);
+}
+
+const void* Mesh::lodIndexOffset(const MeshLod& lod) const
+{
+    return (const void*)(uintptr_t(geometry->firstIndex + lod.firstIndex) * IndexTypeSize(geometry->indexType));
+}
+
+GeometryArena& Mesh::Arena() const
+{
+    return GeometryArena::Get(*layout, geometry->indexType);
+}
+
+DrawElementsIndirectCommand Mesh::IndirectCommand(GLuint instanceCount, GLuint baseInstance, unsigned int lod) const
+{
+    const MeshLod& range = Lod(lod);
+    return {range.indexCount, instanceCount, geometry->firstIndex + range.firstIndex, geometry->baseVertex, baseInstance};
+}
+
+void Mesh::BindTextures(Shader &shader)
+{
+    for(unsigned int i = 0; i < textures.size(); i++)
+    {
+        shader.setInt(samplerHandles[i], i);
+        GLState::BindTexture(i, GL_TEXTURE_2D, textures[i].id);
+    }
+}
+
+Mesh::Mesh(const VertexLayout& layout, const void* vertexData, const glm::vec3* positions, GLuint vertexCount,
+           const unsigned int* indices, GLuint indexCount, std::vector<Texture> textures, GLenum drawMode,
+           std::vector<MeshLod> lods, std::vector<Meshlet> meshlets, const AABB& bounds, const BoundingSphere& boundingSphere)
+    : textures(std::move(textures)), lods(std::move(lods)), meshlets(std::move(meshlets)), layout(&layout), drawMode(drawMode),
+      bounds(bounds), boundingSphere(boundingSphere)
+{
+    setupSamplers();
+    if (this->lods.empty())
+        this->lods.push_back({0, indexCount, 0.0f});
+    uploadGeometry(positions, vertexData, vertexCount, indices, indexCount);
+}
+
+Mesh Mesh::ShareGeometry(const Mesh& source, std::vector<Texture> textures)
+{
+    Mesh mesh;
+    mesh.geometry = source.geometry;
+    mesh.textures = std::move(textures);
+    mesh.lods = source.lods;
+    mesh.meshlets = source.meshlets;
+    mesh.layout = source.layout;
+    mesh.VAO = source.VAO;
+    mesh.drawMode = source.drawMode;
+    mesh.doubleSided = source.doubleSided;
+    mesh.bounds = source.bounds;
+    mesh.boundingSphere = source.boundingSphere;
+    mesh.setupSamplers();
+    return mesh;
+}
+
+void Mesh::setupSamplers()
 {
     unsigned int diffuseNr  = 1;
     unsigned int specularNr = 1;
     unsigned int normalNr   = 1;
     unsigned int heightNr   = 1;
 
+    samplerHandles.clear();
     for(unsigned int i = 0; i < textures.size(); i++)
     {
-        glActiveTexture(GL_TEXTURE0 + i);
         std::string number;
         std::string name = textures[i].type;
         if(name == "texture_diffuse") number = std::to_string(diffuseNr++);
         else if(name == "texture_specular") number = std::to_string(specularNr++);
         else if(name == "texture_normal") number = std::to_string(normalNr++);
         else if(name == "texture_height") number = std::to_string(heightNr++);
-        shader.setInt(("material." + name + number).c_str(), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        samplerHandles.push_back(UniformHandle("material." + name + number));
     }
+}
 
-    glBindVertexArray(VAO);
-    glDrawElements(this->drawMode, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+void Mesh::setupMesh()
+{
+    setupSamplers();
 
-    glActiveTexture(GL_TEXTURE0);
+    if (lods.empty())
+        lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+
+    uploadGeometry(positions.data(), vertexData.data(), static_cast<GLuint>(positions.size()), indices.data(), static_cast<GLuint>(indices.size()));
 }
 
-void Mesh::setupMesh()
+void Mesh::uploadGeometry(const glm::vec3* positions, const void* vertexData, GLuint vertexCount, const unsigned int* indices, GLuint indexCount)
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-    // Position
-    glEnableVertexAttribArray(0);	
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // Normal
-    glEnableVertexAttribArray(1);	
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    // TexCoords
-    glEnableVertexAttribArray(2);	
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-    // Tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-    // Bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-    glBindVertexArray(0);
+    GeometryArena& arena = GeometryArena::Get(*layout, ChooseIndexType(vertexCount));
+    VAO = arena.VAO();
+    geometry = GeometryHandle(*layout, arena.Allocate(vertexCount, indexCount));
+    // Lands over the next frames; IsResident reports when
+    geometry.SetUpload(GeometryUploadQueue::Enqueue(arena, *geometry, positions, vertexData, indices));
 }
\ No newline at end of file
@@ -3,27 +3,135 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "Shader.h"
 #include "RenderTypes.h"
+#include "GeometryArena.h"
+#include "VertexFormat.h"
+#include "FrustumCulling.h"
 
+// Move-only: the GPU range is owned through geometry and freed with the
+// last mesh sharing it (ShareGeometry)
 class Mesh {
 public:
-    std::vector<Vertex>       vertices;
+    // Where this mesh lives inside the arena's buffers. Declared first so a
+    // move assignment releases it, and any upload still reading the arrays
+    // below, before they are replaced.
+    GeometryHandle geometry;
+
+    // CPU copies of what was uploaded; empty after ReleaseCpuData.
+    // Vertices exactly as uploaded, layout->stride bytes each
+    std::vector<uint8_t>      vertexData;
+    // Object-space positions
+    std::vector<glm::vec3>    positions;
+    // Every LOD's index list, back to back
     std::vector<unsigned int> indices;
     std::vector<Texture>      textures;
+    // LOD 0 first, then coarser levels over the same vertices; never empty
+    std::vector<MeshLod>      lods;
+    // Clusters covering LOD 0 for per-cluster culling; empty for small meshes
+    std::vector<Meshlet>      meshlets;
+    // Static layout table; also selects the GeometryArena
+    const VertexLayout* layout = nullptr;
+    // The shared VAO of this mesh's GeometryArena; kept so callers can still sort/bind by it
     unsigned int VAO;
 
     GLenum drawMode;
+    // Single-sided meshes draw with back-face culling, which also lets their
+    // meshlets be cone-culled
+    bool doubleSided = true;
+
+    // Object-space bounds, computed once from the vertices at construction
+    // and kept when the CPU data is released
+    AABB bounds;
+    BoundingSphere boundingSphere;
+
+    ~Mesh();
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // Imported vertices, stored in the smallest compact format that fits them
+    // and the vertexStreams (kVertexStreamFlags) the shader reads (VertexFormat.h)
+    // lods describe ranges of indices (MeshSimplifier::BuildLodChain); empty means LOD 0 only
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, GLenum drawMode = GL_TRIANGLES,
+         std::vector<MeshLod> lods = {}, std::vector<Meshlet> meshlets = {}, uint32_t vertexStreams = 0);
+
+    // Geometry already in its final encoded form (a MeshCache entry), uploaded
+    // straight from these arrays with no CPU copy kept. They must stay valid
+    // until the upload is staged (ReleaseCpuData waits for that).
+    Mesh(const VertexLayout& layout, const void* vertexData, const glm::vec3* positions, GLuint vertexCount,
+         const unsigned int* indices, GLuint indexCount, std::vector<Texture> textures, GLenum drawMode,
+         std::vector<MeshLod> lods, std::vector<Meshlet> meshlets, const AABB& bounds, const BoundingSphere& boundingSphere);
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, GLenum drawMode = GL_TRIANGLES);
+    // A mesh drawing source's GPU geometry (same range, LODs and meshlets)
+    // with its own textures. Keeps no CPU copy of the data.
+    static Mesh ShareGeometry(const Mesh& source, std::vector<Texture> textures);
 
-    void Draw(Shader &shader);
+    // Any vertex struct with a VertexTraits layout, uploaded as is
+    template <typename V, typename = std::enable_if_t<!std::is_same<V, Vertex>::value>>
+    Mesh(const std::vector<V>& vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, GLenum drawMode = GL_TRIANGLES)
+        : indices(std::move(indices)), textures(std::move(textures)), layout(&LayoutOf<V>()), drawMode(drawMode)
+    {
+        static_assert(std::is_trivially_copyable<V>::value, "vertex types are uploaded byte for byte");
+        static_assert(sizeof(V) == LayoutOf<V>().stride, "VertexTraits stride does not match the struct");
+        static_assert(HasFloat3Position<V>(), "vertex types need a vec3 Position at VERTEX_LOCATION_POSITION");
+
+        vertexData.resize(vertices.size() * sizeof(V));
+        if (!vertices.empty()) std::memcpy(vertexData.data(), vertices.data(), vertexData.size());
+        positions.reserve(vertices.size());
+        for (const V& v : vertices)
+            positions.push_back(v.Position);
+
+        computeBounds();
+        setupMesh();
+    }
+
+    // lod is clamped to the coarsest level this mesh has
+    void Draw(Shader &shader, unsigned int lod = 0);
+    // Draws instanceCount copies, reading per-instance model matrices from
+    // instanceBuffer at byteOffset (attribute locations 5-8)
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod = 0);
+    // Position-only versions for the depth pre-pass; no textures are bound
+    void DrawDepth(unsigned int lod = 0);
+    void DrawDepthInstanced(unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod = 0);
+    // Draws only the given ranges of the index list (culled meshlets) in one glMultiDrawElementsBaseVertex
+    void DrawRanges(Shader &shader, const std::vector<IndexRange>& ranges);
+    void DrawDepthRanges(const std::vector<IndexRange>& ranges);
+    // Sets GL_CULL_FACE for this mesh; every draw above calls it
+    void ApplyFaceCulling() const;
+
+    void BindTextures(Shader &shader);
+    // Drops the CPU copies of vertices and indices; drawing only needs the GPU side.
+    // Waits for an upload worker still reading them.
+    void ReleaseCpuData();
+    // False until the GeometryUploadQueue upload has landed; draws skip the mesh until then
+    bool IsResident() const { return geometry.Resident(); }
+    // The arena holding this mesh, which depends on its layout and index type
+    GeometryArena& Arena() const;
+    // Entry for a glMultiDrawElementsIndirect command buffer
+    DrawElementsIndirectCommand IndirectCommand(GLuint instanceCount, GLuint baseInstance, unsigned int lod = 0) const;
+    const MeshLod& Lod(unsigned int lod) const { return lods[std::min<size_t>(lod, lods.size() - 1)]; }
+    // Meshlets only cover LOD 0
+    bool UsesMeshlets(unsigned int lod) const { return !meshlets.empty() && &Lod(lod) == &lods[0]; }
 
 private:
-    unsigned int VBO, EBO;
+    // Handles for "material.texture_diffuse1" etc., built once so Draw does no string work
+    std::vector<UniformHandle> samplerHandles;
+
+    Mesh() = default;
+    void setupSamplers();
     void setupMesh();
+    void uploadGeometry(const glm::vec3* positions, const void* vertexData, GLuint vertexCount, const unsigned int* indices, GLuint indexCount);
+    // Byte offset of a LOD's first index within the arena's index buffer
+    const void* lodIndexOffset(const MeshLod& lod) const;
+    void multiDrawRanges(const std::vector<IndexRange>& ranges);
+    void computeBounds();
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,300 @@
+#include "MeshCache.h"
+#include "Profiler.h"
+#include "VertexFormat.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr uint32_t kCacheMagic = 0x4853454D; // "MESH"
+static constexpr uint64_t kAlignment = 16;
+
+static_assert(sizeof(MeshCacheHeader) == 64 && sizeof(MeshCacheMesh) == 128 && sizeof(MeshCacheTexture) == 40,
+              "mesh cache records changed size; bump MeshCache::kVersion");
+static_assert(std::is_trivially_copyable<MeshLod>::value && std::is_trivially_copyable<Meshlet>::value &&
+              std::is_trivially_copyable<AABB>::value && std::is_trivially_copyable<BoundingSphere>::value,
+              "cached types are read straight from the mapping");
+
+static std::string s_CacheDirectory = "mesh_cache";
+
+static uint64_t AlignUp(uint64_t value)
+{
+    return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+static std::filesystem::path EntryPath(const std::string& sourcePath, uint32_t vertexStreams)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(sourcePath, error);
+    const std::string key = error ? sourcePath : canonical.string();
+
+    // 64-bit FNV-1a of the canonical path and the streams, so models reading
+    // different streams from one source keep an entry each; the stem just
+    // makes the directory readable
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key)
+        hash = (hash ^ c) * 1099511628211ull;
+    for (int shift = 0; shift < 32; shift += 8)
+        hash = (hash ^ ((vertexStreams >> shift) & 0xFF)) * 1099511628211ull;
+
+    char file[32];
+    std::snprintf(file, sizeof(file), "-%016llx.mesh", static_cast<unsigned long long>(hash));
+    return std::filesystem::path(s_CacheDirectory) / (std::filesystem::path(sourcePath).stem().string() + file);
+}
+
+static bool SourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time)
+{
+    std::error_code error;
+    size = std::filesystem::file_size(sourcePath, error);
+    if (error) return false;
+    time = static_cast<int64_t>(std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count());
+    return !error;
+}
+
+std::unique_ptr<MeshCache> MeshCache::Open(const std::string& sourcePath, uint32_t vertexStreams)
+{
+    PROFILE_CPU_SCOPE("MeshCache::Open");
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    if (!SourceStamp(sourcePath, sourceSize, sourceTime)) return nullptr;
+
+    std::unique_ptr<MeshCache> cache(new MeshCache());
+    if (!cache->map(EntryPath(sourcePath, vertexStreams).string()) || !cache->validate(sourceSize, sourceTime, vertexStreams))
+        return nullptr;
+    return cache;
+}
+
+MeshCache::~MeshCache()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapped) munmap(const_cast<unsigned char*>(data), size);
+#endif
+}
+
+bool MeshCache::map(const std::string& path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(MeshCacheHeader)))
+    {
+        close(fd);
+        return false;
+    }
+    // The mapping stays valid after the descriptor is closed
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return false;
+
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(info.st_size);
+    mapped = true;
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    const std::streamoff length = file.tellg();
+    if (length < static_cast<std::streamoff>(sizeof(MeshCacheHeader))) return false;
+    contents.resize(static_cast<size_t>(length));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(contents.data()), length)) return false;
+
+    data = contents.data();
+    size = contents.size();
+    return true;
+#endif
+}
+
+// Structure only: every record and array lies inside the file and refers to
+// things that exist. The array contents are trusted, as with a fresh import.
+bool MeshCache::validate(uint64_t sourceSize, int64_t sourceTime, uint32_t vertexStreams) const
+{
+    const MeshCacheHeader& header = Header();
+    if (header.magic != kCacheMagic || header.version != kVersion || header.fileSize != size) return false;
+    if (header.sourceSize != sourceSize || header.sourceTime != sourceTime || header.vertexStreams != vertexStreams) return false;
+
+    auto inside = [&](uint64_t offset, uint64_t count, uint64_t elementSize) {
+        return offset % kAlignment == 0 && offset <= size && count <= (size - offset) / elementSize;
+    };
+    if (!inside(header.meshesOffset, header.meshCount, sizeof(MeshCacheMesh)) ||
+        !inside(header.texturesOffset, header.textureCount, sizeof(MeshCacheTexture)))
+        return false;
+
+    for (uint32_t i = 0; i < header.textureCount; i++)
+    {
+        const MeshCacheTexture& texture = TextureRecord(i);
+        if (!inside(texture.typeOffset, texture.typeLength, 1) || !inside(texture.pathOffset, texture.pathLength, 1) ||
+            !inside(texture.imageOffset, texture.imageSize, 1))
+            return false;
+    }
+
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+        const MeshCacheMesh& mesh = MeshRecord(i);
+        if (!inside(mesh.texturesOffset, mesh.textureCount, sizeof(uint32_t))) return false;
+        for (uint32_t t = 0; t < mesh.textureCount; t++)
+            if (At<uint32_t>(mesh.texturesOffset)[t] >= header.textureCount) return false;
+
+        if (mesh.sharedWith >= 0)
+        {
+            if (static_cast<uint32_t>(mesh.sharedWith) >= i) return false;
+            continue;
+        }
+
+        if (mesh.vertexFormat >= kVertexFormatCount || mesh.vertexCount == 0 || mesh.lodCount == 0) return false;
+        // Only streams the entry was written for, and one normal encoding at most
+        const uint32_t allowed = VERTEX_FORMAT_UV_HALF | header.vertexStreams |
+                                 ((header.vertexStreams & VERTEX_FORMAT_QTANGENT) ? VERTEX_FORMAT_NORMAL : 0u);
+        if ((mesh.vertexFormat & ~allowed) != 0 ||
+            ((mesh.vertexFormat & VERTEX_FORMAT_NORMAL) && (mesh.vertexFormat & VERTEX_FORMAT_QTANGENT)))
+            return false;
+        if (!inside(mesh.vertexDataOffset, mesh.vertexCount, GetVertexLayout(mesh.vertexFormat).stride) ||
+            !inside(mesh.positionsOffset, mesh.vertexCount, sizeof(glm::vec3)) ||
+            !inside(mesh.indicesOffset, mesh.indexCount, sizeof(uint32_t)) ||
+            !inside(mesh.lodsOffset, mesh.lodCount, sizeof(MeshLod)) ||
+            !inside(mesh.meshletsOffset, mesh.meshletCount, sizeof(Meshlet)))
+            return false;
+
+        // LOD and meshlet ranges are drawn as they are
+        auto rangeInside = [&](uint32_t first, uint32_t count) {
+            return first <= mesh.indexCount && count <= mesh.indexCount - first;
+        };
+        for (uint32_t l = 0; l < mesh.lodCount; l++)
+        {
+            const MeshLod& lod = At<MeshLod>(mesh.lodsOffset)[l];
+            if (!rangeInside(lod.firstIndex, lod.indexCount)) return false;
+        }
+        for (uint32_t m = 0; m < mesh.meshletCount; m++)
+        {
+            const Meshlet& meshlet = At<Meshlet>(mesh.meshletsOffset)[m];
+            if (!rangeInside(meshlet.firstIndex, meshlet.indexCount)) return false;
+        }
+    }
+    return true;
+}
+
+bool MeshCache::Write(const std::string& sourcePath, const MeshCacheContents& contents)
+{
+    PROFILE_CPU_SCOPE("MeshCache::Write");
+    MeshCacheHeader header = {};
+    header.magic = kCacheMagic;
+    header.version = kVersion;
+    if (!SourceStamp(sourcePath, header.sourceSize, header.sourceTime))
+    {
+        std::cout << "ERROR::MESH_CACHE::NO_SOURCE: " << sourcePath << std::endl;
+        return false;
+    }
+    header.meshCount = static_cast<uint32_t>(contents.meshes.size());
+    header.textureCount = static_cast<uint32_t>(contents.textures.size());
+    header.flags = contents.flags;
+    header.vertexStreams = contents.vertexStreams;
+    header.meshesOffset = AlignUp(sizeof(MeshCacheHeader));
+    header.texturesOffset = AlignUp(header.meshesOffset + header.meshCount * sizeof(MeshCacheMesh));
+
+    // Arrays follow the records
+    const uint64_t bodyStart = AlignUp(header.texturesOffset + header.textureCount * sizeof(MeshCacheTexture));
+    std::vector<unsigned char> body;
+    auto append = [&](const void* bytes, size_t count) {
+        body.resize(AlignUp(body.size()));
+        const uint64_t offset = bodyStart + body.size();
+        const unsigned char* begin = static_cast<const unsigned char*>(bytes);
+        if (count > 0) body.insert(body.end(), begin, begin + count);
+        return offset;
+    };
+
+    std::vector<MeshCacheTexture> textures(header.textureCount);
+    for (uint32_t i = 0; i < header.textureCount; i++)
+    {
+        const MeshCacheTextureData& texture = contents.textures[i];
+        MeshCacheTexture& record = textures[i];
+        record.typeOffset = append(texture.type.data(), texture.type.size());
+        record.typeLength = static_cast<uint32_t>(texture.type.size());
+        record.pathOffset = append(texture.path.data(), texture.path.size());
+        record.pathLength = static_cast<uint32_t>(texture.path.size());
+        record.imageOffset = append(texture.image.data, texture.image.size);
+        record.imageSize = texture.image.size;
+    }
+
+    std::vector<MeshCacheMesh> meshes(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+        const MeshCacheMeshData& mesh = contents.meshes[i];
+        MeshCacheMesh& record = meshes[i];
+        record.drawMode = mesh.drawMode;
+        record.doubleSided = mesh.doubleSided ? 1 : 0;
+        record.bounds = mesh.bounds;
+        record.boundingSphere = mesh.boundingSphere;
+        record.textureCount = static_cast<uint32_t>(mesh.textures.size());
+        record.texturesOffset = append(mesh.textures.data(), mesh.textures.size() * sizeof(uint32_t));
+        record.sharedWith = mesh.sharedWith;
+        if (record.sharedWith >= 0) continue;
+
+        record.vertexFormat = mesh.vertexFormat;
+        record.vertexCount = mesh.vertexCount;
+        record.indexCount = mesh.indexCount;
+        record.lodCount = mesh.lodCount;
+        record.meshletCount = mesh.meshletCount;
+        record.vertexDataOffset = append(mesh.vertexData, mesh.vertexDataSize);
+        record.positionsOffset = append(mesh.positions, mesh.vertexCount * sizeof(glm::vec3));
+        record.indicesOffset = append(mesh.indices, mesh.indexCount * sizeof(unsigned int));
+        record.lodsOffset = append(mesh.lods, mesh.lodCount * sizeof(MeshLod));
+        record.meshletsOffset = append(mesh.meshlets, mesh.meshletCount * sizeof(Meshlet));
+    }
+    body.resize(AlignUp(body.size()));
+    header.fileSize = bodyStart + body.size();
+
+    std::error_code error;
+    std::filesystem::create_directories(s_CacheDirectory, error);
+
+    // Write under a temporary name so a crash never leaves a truncated entry behind
+    std::filesystem::path path = EntryPath(sourcePath, contents.vertexStreams);
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE: " << temp.string() << std::endl;
+            return false;
+        }
+        // Zero padding between sections keeps the file deterministic
+        std::vector<char> padding(kAlignment, 0);
+        auto pad = [&](uint64_t to) { file.write(padding.data(), static_cast<std::streamsize>(to - static_cast<uint64_t>(file.tellp()))); };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        pad(header.meshesOffset);
+        file.write(reinterpret_cast<const char*>(meshes.data()), meshes.size() * sizeof(MeshCacheMesh));
+        pad(header.texturesOffset);
+        file.write(reinterpret_cast<const char*>(textures.data()), textures.size() * sizeof(MeshCacheTexture));
+        pad(bodyStart);
+        file.write(reinterpret_cast<const char*>(body.data()), static_cast<std::streamsize>(body.size()));
+        file.close();
+        if (!file)
+        {
+            std::cout << "ERROR::MESH_CACHE::WRITE_FAILED: " << temp.string() << std::endl;
+            std::filesystem::remove(temp, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temp, path, error);
+    if (error)
+    {
+        std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE: " << path.string() << std::endl;
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    return true;
+}
+
+void MeshCache::SetDirectory(const std::string& directory)
+{
+    s_CacheDirectory = directory;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "RenderTypes.h"
+
+// Encoded bytes of a texture embedded in the source file
+struct MeshCacheImage {
+    const void* data = nullptr;
+    size_t size = 0;
+};
+
+// A material texture as Write takes it
+struct MeshCacheTextureData {
+    std::string type;
+    std::string path;
+    MeshCacheImage image;           // empty: not embedded
+};
+
+// A mesh as Write takes it. The arrays are borrowed for the call only.
+struct MeshCacheMeshData {
+    uint32_t vertexFormat = 0;      // VertexFormatFlags of vertexData
+    uint32_t drawMode = 0;
+    bool doubleSided = true;
+    AABB bounds;
+    BoundingSphere boundingSphere;
+    std::vector<uint32_t> textures; // indices into MeshCacheContents::textures
+    // Earlier mesh whose geometry this one draws, or -1; its arrays are then ignored
+    int32_t sharedWith = -1;
+    const void* vertexData = nullptr;
+    size_t vertexDataSize = 0;
+    const glm::vec3* positions = nullptr;
+    uint32_t vertexCount = 0;
+    const unsigned int* indices = nullptr;
+    uint32_t indexCount = 0;
+    const MeshLod* lods = nullptr;
+    uint32_t lodCount = 0;
+    const Meshlet* meshlets = nullptr;
+    uint32_t meshletCount = 0;
+};
+
+struct MeshCacheContents {
+    uint32_t flags = 0;             // MeshCacheFlags
+    uint32_t vertexStreams = 0;     // kVertexStreamFlags the vertex formats were chosen for
+    std::vector<MeshCacheTextureData> textures;
+    std::vector<MeshCacheMeshData> meshes;
+};
+
+enum MeshCacheFlags : uint32_t {
+    MESH_CACHE_TRANSPARENT = 1u << 0,
+};
+
+// File layout, native byte order. All offsets are from the start of the file
+// and every array starts 16-byte aligned.
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t fileSize;
+    // Size and modification time of the source when the entry was written
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t flags;             // MeshCacheFlags
+    uint32_t vertexStreams;     // what the vertex data was encoded for, see Model::vertexStreams
+    uint64_t meshesOffset;      // MeshCacheMesh[meshCount]
+    uint64_t texturesOffset;    // MeshCacheTexture[textureCount]
+};
+
+struct MeshCacheMesh {
+    uint32_t vertexFormat;      // VertexFormatFlags
+    uint32_t vertexCount;
+    uint32_t indexCount;        // every LOD, back to back
+    uint32_t lodCount;
+    uint32_t meshletCount;
+    uint32_t textureCount;
+    // Earlier mesh whose geometry this one draws (Mesh::ShareGeometry), or -1.
+    // Sharing meshes store no arrays of their own.
+    int32_t  sharedWith;
+    uint32_t drawMode;
+    uint32_t doubleSided;
+    uint32_t reserved;
+    AABB bounds;
+    BoundingSphere boundingSphere;
+    uint64_t vertexDataOffset;  // vertexCount * stride of the format
+    uint64_t positionsOffset;   // glm::vec3[vertexCount]
+    uint64_t indicesOffset;     // uint32_t[indexCount]
+    uint64_t lodsOffset;        // MeshLod[lodCount]
+    uint64_t meshletsOffset;    // Meshlet[meshletCount]
+    uint64_t texturesOffset;    // uint32_t[textureCount], indices into the texture records
+};
+
+struct MeshCacheTexture {
+    uint64_t typeOffset;
+    uint64_t pathOffset;
+    uint64_t imageOffset;
+    uint64_t imageSize;         // 0: not embedded, load path from the model's directory
+    uint32_t typeLength;
+    uint32_t pathLength;
+};
+
+// On-disk cache of imported models, so a warm start skips Assimp and the
+// import-time welding, optimization, LOD and meshlet passes.
+//
+// An entry holds each mesh's final encoded vertex data, positions, index
+// lists, LODs, meshlets and bounds, plus material references. Everything is
+// stored exactly as GeometryArena uploads it, so loading is a memory map
+// and pointer arithmetic, with no parsing. Entries are keyed by the source
+// path and the vertex streams they were encoded for, and carry the source's
+// size and modification time, so an edited source or a different kVersion
+// simply misses.
+class MeshCache {
+public:
+    // Bump whenever the records, the vertex encodings or the import passes change
+    static constexpr uint32_t kVersion = 3;
+
+    // Maps the entry for sourcePath encoded for vertexStreams; null on a miss
+    // or a damaged file
+    static std::unique_ptr<MeshCache> Open(const std::string& sourcePath, uint32_t vertexStreams = 0);
+    // Writes the entry for sourcePath and contents.vertexStreams, stamped with
+    // the source's current size and modification time. Failures are logged
+    // and leave no entry behind.
+    static bool Write(const std::string& sourcePath, const MeshCacheContents& contents);
+
+    static void SetDirectory(const std::string& directory);
+
+    ~MeshCache();
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    const MeshCacheHeader& Header() const { return *At<MeshCacheHeader>(0); }
+    const MeshCacheMesh& MeshRecord(uint32_t index) const { return At<MeshCacheMesh>(Header().meshesOffset)[index]; }
+    const MeshCacheTexture& TextureRecord(uint32_t index) const { return At<MeshCacheTexture>(Header().texturesOffset)[index]; }
+
+    // Points into the mapping; valid as long as this object
+    template <typename T>
+    const T* At(uint64_t offset) const { return reinterpret_cast<const T*>(data + offset); }
+    std::string String(uint64_t offset, uint32_t length) const { return std::string(At<char>(offset), length); }
+
+private:
+    MeshCache() = default;
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    // File contents where memory mapping is not available
+    std::vector<unsigned char> contents;
+
+    bool map(const std::string& path);
+    bool validate(uint64_t sourceSize, int64_t sourceTime, uint32_t vertexStreams) const;
+};
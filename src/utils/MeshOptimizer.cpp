@@ -0,0 +1,415 @@
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+static constexpr unsigned int kNoTriangle = ~0u;
+static constexpr unsigned int kUnused = ~0u;
+
+// Forsyth's tuning constants; the cache model is LRU
+static constexpr int kCacheSize = 32;
+static constexpr float kCacheDecayPower = 1.5f;
+static constexpr float kLastTriangleScore = 0.75f;
+static constexpr float kValenceBoostScale = 2.0f;
+static constexpr float kValenceBoostPower = 0.5f;
+
+static float VertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    // Nothing left to draw with it, so keeping it cached is worthless
+    if (remainingTriangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // The last triangle's vertices get a fixed score so the next triangle
+        // does not just reuse the same edge and strip along
+        if (cachePosition < 3)
+            score = kLastTriangleScore;
+        else
+            score = std::pow(1.0f - float(cachePosition - 3) / float(kCacheSize - 3), kCacheDecayPower);
+    }
+    // Finish off vertices with few triangles left before they fall out
+    score += kValenceBoostScale * std::pow(float(remainingTriangles), -kValenceBoostPower);
+    return score;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2 || vertexCount == 0) return;
+
+    // Triangles using each vertex, packed per vertex. Emitted triangles are
+    // swapped to the end of their vertex's range and the range shrinks.
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        offsets[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            adjacency[offsets[v] + remaining[v]++] = static_cast<unsigned int>(t);
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = VertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(kCacheSize + 3);
+    nextCache.reserve(kCacheSize + 3);
+
+    unsigned int best = static_cast<unsigned int>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    size_t scanCursor = 0;
+    while (best != kNoTriangle)
+    {
+        emitted[best] = true;
+        const unsigned int tri[3] = {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+        result.insert(result.end(), tri, tri + 3);
+
+        for (unsigned int v : tri)
+        {
+            unsigned int* live = &adjacency[offsets[v]];
+            unsigned int* last = live + remaining[v] - 1;
+            std::iter_swap(std::find(live, last, best), last);
+            remaining[v]--;
+        }
+
+        // LRU: this triangle's vertices move to the front, the rest shift back
+        nextCache.clear();
+        for (unsigned int v : tri)
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end()) nextCache.push_back(v);
+        for (unsigned int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2]) nextCache.push_back(v);
+
+        // Rescore everything whose cache position changed, including what fell out
+        for (size_t i = 0; i < nextCache.size(); i++)
+        {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < size_t(kCacheSize) ? static_cast<int>(i) : -1;
+            float score = VertexScore(cachePosition[v], remaining[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+                triangleScore[adjacency[j]] += delta;
+        }
+        if (nextCache.size() > size_t(kCacheSize)) nextCache.resize(kCacheSize);
+        std::swap(cache, nextCache);
+
+        // Best candidate among triangles touching the cache
+        best = kNoTriangle;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache)
+        {
+            for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+            {
+                unsigned int t = adjacency[j];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        // Dead end: restart from the next triangle not drawn yet
+        if (best == kNoTriangle)
+        {
+            while (scanCursor < triangleCount && emitted[scanCursor]) scanCursor++;
+            if (scanCursor < triangleCount) best = static_cast<unsigned int>(scanCursor);
+        }
+    }
+
+    indices.swap(result);
+}
+
+// Cache misses per triangle with a FIFO cache: a vertex is cached while
+// fewer than cacheSize misses happened since it was last loaded
+static void SimulateFifo(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize, std::vector<unsigned int>& misses)
+{
+    std::vector<unsigned int> loadedAt(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    misses.assign(indices.size() / 3, 0);
+    for (size_t t = 0; t < misses.size(); t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (time - loadedAt[v] > cacheSize)
+            {
+                loadedAt[v] = time++;
+                misses[t]++;
+            }
+        }
+    }
+}
+
+float MeshOptimizer::AverageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    if (indices.size() < 3) return 0.0f;
+    std::vector<unsigned int> misses;
+    SimulateFifo(indices, vertexCount, cacheSize, misses);
+    return float(std::accumulate(misses.begin(), misses.end(), 0u)) / float(misses.size());
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, float threshold)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) return;
+
+    std::vector<unsigned int> misses;
+    SimulateFifo(indices, positions.size(), 16, misses);
+
+    // Hard boundaries where the cache is cold anyway (all three vertices
+    // missed), then soft ones inside each run wherever the run so far is no
+    // worse than threshold times the run's own ACMR
+    std::vector<unsigned int> clusterStarts;
+    for (size_t begin = 0; begin < triangleCount;)
+    {
+        size_t end = begin + 1;
+        while (end < triangleCount && misses[end] < 3) end++;
+
+        unsigned int runMisses = 0;
+        for (size_t t = begin; t < end; t++) runMisses += misses[t];
+        const float target = threshold * float(runMisses) / float(end - begin);
+
+        clusterStarts.push_back(static_cast<unsigned int>(begin));
+        unsigned int clusterMisses = 0;
+        size_t clusterBegin = begin;
+        for (size_t t = begin; t < end; t++)
+        {
+            if (t > clusterBegin && misses[t] >= 2 && float(clusterMisses) / float(t - clusterBegin) <= target)
+            {
+                clusterStarts.push_back(static_cast<unsigned int>(t));
+                clusterBegin = t;
+                clusterMisses = 0;
+            }
+            clusterMisses += misses[t];
+        }
+        begin = end;
+    }
+    if (clusterStarts.size() < 2) return;
+    clusterStarts.push_back(static_cast<unsigned int>(triangleCount));
+
+    glm::vec3 meshCentroid(0.0f);
+    for (unsigned int index : indices)
+        meshCentroid += positions[index];
+    meshCentroid /= float(indices.size());
+
+    // Clusters facing away from the middle of the mesh are the likely
+    // occluders, so they go first
+    const size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 normal(0.0f), centroid(0.0f);
+        float area = 0.0f;
+        for (unsigned int t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& p = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, p - a);
+            float triangleArea = glm::length(n);
+            normal += n;
+            centroid += (a + b + p) * (triangleArea / 3.0f);
+            area += triangleArea;
+        }
+        float normalLength = glm::length(normal);
+        if (area <= 0.0f || normalLength <= 0.0f) continue;
+        sortKey[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+    }
+
+    std::vector<unsigned int> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (unsigned int c : order)
+        result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+    indices.swap(result);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+    remap.assign(vertexCount, kUnused);
+    unsigned int next = 0;
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == kUnused) remap[index] = next++;
+        index = remap[index];
+    }
+    return next;
+}
+
+// Sphere around the AABB center, cone around the mean triangle normal
+static Meshlet FinishMeshlet(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t first, size_t end)
+{
+    Meshlet meshlet;
+    meshlet.firstIndex = static_cast<uint32_t>(first);
+    meshlet.indexCount = static_cast<uint32_t>(end - first);
+
+    AABB box;
+    for (size_t i = first; i < end; i++)
+        box.Expand(vertices[indices[i]].Position);
+    meshlet.center = box.Center();
+    for (size_t i = first; i < end; i++)
+        meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+    glm::vec3 axis(0.0f);
+    for (size_t i = first; i < end; i += 3)
+    {
+        glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - vertices[indices[i]].Position,
+                                 vertices[indices[i + 2]].Position - vertices[indices[i]].Position);
+        float length = glm::length(n);
+        if (length > 0.0f) axis += n / length;
+    }
+    float axisLength = glm::length(axis);
+    if (axisLength <= 0.0f) return meshlet;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (size_t i = first; i < end; i += 3)
+    {
+        glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - vertices[indices[i]].Position,
+                                 vertices[indices[i + 2]].Position - vertices[indices[i]].Position);
+        float length = glm::length(n);
+        if (length > 0.0f) minDot = std::min(minDot, glm::dot(axis, n / length));
+    }
+    // A cone of 90 degrees or more never hides the whole cluster
+    if (minDot <= 0.0f) return meshlet;
+
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    return meshlet;
+}
+
+std::vector<Meshlet> MeshOptimizer::BuildMeshlets(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                                  size_t indexCount, unsigned int maxVertices, unsigned int maxTriangles)
+{
+    std::vector<Meshlet> meshlets;
+    indexCount = std::min(indexCount, indices.size());
+    if (indexCount % 3 != 0 || indexCount / 3 <= maxTriangles) return meshlets;
+
+    // Which meshlet last used each vertex, so a vertex counts once per meshlet
+    std::vector<unsigned int> usedBy(vertices.size(), kUnused);
+    unsigned int meshletId = 0, vertexCount = 0, triangleCount = 0;
+    size_t first = 0;
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        const unsigned int* tri = &indices[i];
+        auto newVertices = [&]() {
+            unsigned int n = 0;
+            for (int k = 0; k < 3; k++)
+                if (usedBy[tri[k]] != meshletId && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) n++;
+            return n;
+        };
+
+        if (triangleCount + 1 > maxTriangles || vertexCount + newVertices() > maxVertices)
+        {
+            meshlets.push_back(FinishMeshlet(vertices, indices, first, i));
+            first = i;
+            meshletId++;
+            vertexCount = triangleCount = 0;
+        }
+        vertexCount += newVertices();
+        for (int k = 0; k < 3; k++) usedBy[tri[k]] = meshletId;
+        triangleCount++;
+    }
+    meshlets.push_back(FinishMeshlet(vertices, indices, first, indexCount));
+    return meshlets;
+}
+
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    PROFILE_CPU_SCOPE("MeshOptimizer::Optimize");
+    if (indices.size() < 3 || indices.size() % 3 != 0) return;
+    for (unsigned int index : indices)
+        if (index >= vertices.size()) return;
+
+    OptimizeVertexCache(indices, vertices.size());
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++)
+        positions[v] = vertices[v].Position;
+    OptimizeOverdraw(indices, positions);
+
+    std::vector<unsigned int> remap;
+    size_t used = OptimizeVertexFetch(indices, vertices.size(), remap);
+    std::vector<Vertex> reordered(used);
+    for (size_t v = 0; v < vertices.size(); v++)
+        if (remap[v] != kUnused) reordered[remap[v]] = vertices[v];
+    vertices.swap(reordered);
+}
+
+static constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+static constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash = kFnvOffset)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * kFnvPrime;
+    return hash;
+}
+
+// Vertex is all 4-byte members, so there is no padding to hash or compare
+static_assert(sizeof(Vertex) == 22 * 4, "Vertex gained padding; welding compares raw bytes");
+
+size_t MeshOptimizer::WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    PROFILE_CPU_SCOPE("MeshOptimizer::WeldVertices");
+    for (unsigned int index : indices)
+        if (index >= vertices.size()) return vertices.size();
+
+    // Open addressing over the welded vertices, at most half full
+    size_t tableSize = 1;
+    while (tableSize < vertices.size() * 2) tableSize <<= 1;
+    std::vector<unsigned int> table(tableSize, kUnused);
+
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        size_t slot = HashBytes(&vertices[v], sizeof(Vertex)) & (tableSize - 1);
+        while (table[slot] != kUnused && std::memcmp(&welded[table[slot]], &vertices[v], sizeof(Vertex)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == kUnused)
+        {
+            table[slot] = static_cast<unsigned int>(welded.size());
+            welded.push_back(vertices[v]);
+        }
+        remap[v] = table[slot];
+    }
+
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+    return vertices.size();
+}
+
+uint64_t MeshOptimizer::HashGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    const uint64_t sizes[2] = {vertices.size(), indices.size()};
+    uint64_t hash = HashBytes(sizes, sizeof(sizes));
+    hash = HashBytes(vertices.data(), vertices.size() * sizeof(Vertex), hash);
+    return HashBytes(indices.data(), indices.size() * sizeof(unsigned int), hash);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "RenderTypes.h"
+
+// Import-time reordering and clustering of triangle lists. Nothing here
+// changes what is drawn, only the order the GPU sees vertices and triangles in.
+class MeshOptimizer {
+public:
+    // Runs the three passes below on an imported triangle list and drops
+    // vertices no triangle uses. Anything that is not a triangle list is left alone.
+    static void Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+    // Reorders triangles for the post-transform vertex cache (Forsyth's
+    // linear-speed algorithm with a 32-entry LRU model)
+    static void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+    // Cuts the cache-optimized order into clusters where the cache restarts
+    // anyway and draws the most outward-facing clusters first, so fewer
+    // pixels get shaded twice. threshold bounds the ACMR given up for it.
+    static void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, float threshold = 1.05f);
+
+    // Renumbers vertices in first-use order so vertex fetches walk memory
+    // forward. remap[old] is the new index, or ~0u for unused vertices.
+    // Returns the number of vertices still in use.
+    static size_t OptimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount, std::vector<unsigned int>& remap);
+
+    // Cuts the first indexCount indices into meshlets of at most maxVertices
+    // unique vertices and maxTriangles triangles, keeping triangle order.
+    // Meshes that fit in one meshlet get none.
+    static std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                              size_t indexCount, unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+
+    // Merges vertices whose attributes are bit-for-bit identical and points
+    // the indices at the survivor, keeping first-use order. Returns the
+    // number of vertices left.
+    static size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+    // 64-bit FNV-1a over the vertex and index data and their sizes, for
+    // spotting meshes imported more than once
+    static uint64_t HashGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+
+    // Average cache miss ratio (transformed vertices per triangle) for a FIFO cache
+    static float AverageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+};
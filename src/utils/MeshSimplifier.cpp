@@ -0,0 +1,305 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// LODs below this many triangles are not worth a separate index range
+static constexpr size_t kMinLodTriangles = 32;
+// A level has to drop at least this share of triangles to be kept
+static constexpr float kMinLodReduction = 0.2f;
+// Attributes closer than this count as the same on both sides of a vertex
+static constexpr float kSeamEpsilon = 1e-4f;
+
+// Symmetric 4x4 error quadric, sum of area-weighted plane distances squared
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    void AddPlane(const glm::dvec3& n, double d, double w)
+    {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+        weight += q.weight;
+    }
+
+    // Mean squared distance of p to the accumulated planes
+    double Error(const glm::vec3& p) const
+    {
+        if (weight <= 0) return 0;
+        const double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z
+                 + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                 + 2 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(e, 0.0) / weight;
+    }
+};
+
+struct Collapse
+{
+    unsigned int from, to;
+    double cost;
+};
+
+static bool SameAttributes(const Vertex& a, const Vertex& b)
+{
+    return glm::all(glm::lessThanEqual(glm::abs(a.Normal - b.Normal), glm::vec3(kSeamEpsilon))) &&
+           glm::all(glm::lessThanEqual(glm::abs(a.TexCoords - b.TexCoords), glm::vec2(kSeamEpsilon)));
+}
+
+struct PositionHash
+{
+    size_t operator()(const glm::vec3& p) const
+    {
+        // Equality is ==, so -0.0 must hash like +0.0; adding +0.0 folds it over
+        const glm::vec3 folded = p + glm::vec3(0.0f);
+        uint32_t bits[3];
+        std::memcpy(bits, &folded, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+// Vertices at the same position form one group; collapses work on groups so
+// split vertices move together and cracks cannot open
+static std::vector<unsigned int> GroupByPosition(const std::vector<Vertex>& vertices, unsigned int& groupCount)
+{
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> groups;
+    groups.reserve(vertices.size());
+    std::vector<unsigned int> groupOf(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++)
+        groupOf[v] = groups.emplace(vertices[v].Position, static_cast<unsigned int>(groups.size())).first->second;
+    groupCount = static_cast<unsigned int>(groups.size());
+    return groupOf;
+}
+
+static glm::vec3 TriangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    return glm::cross(b - a, c - a);
+}
+
+float MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+                               size_t targetIndexCount, float maxError)
+{
+    if (indices.size() <= targetIndexCount || indices.size() % 3 != 0) return 0.0f;
+
+    unsigned int groupCount = 0;
+    const std::vector<unsigned int> groupOf = GroupByPosition(vertices, groupCount);
+    std::vector<glm::vec3> position(groupCount);
+    for (size_t v = 0; v < vertices.size(); v++)
+        position[groupOf[v]] = vertices[v].Position;
+
+    // Seams: one position, several attribute sets
+    std::vector<bool> locked(groupCount, false);
+    {
+        std::vector<unsigned int> firstVertex(groupCount, ~0u);
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            unsigned int g = groupOf[v];
+            if (firstVertex[g] == ~0u) firstVertex[g] = static_cast<unsigned int>(v);
+            else if (!SameAttributes(vertices[firstVertex[g]], vertices[v])) locked[g] = true;
+        }
+    }
+
+    // Open borders: edges used by one triangle. Counted undirected.
+    {
+        std::unordered_map<uint64_t, int> edgeUse;
+        edgeUse.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = groupOf[indices[i + k]], b = groupOf[indices[i + (k + 1) % 3]];
+                if (a > b) std::swap(a, b);
+                edgeUse[(uint64_t(a) << 32) | b]++;
+            }
+        }
+        for (const auto& edge : edgeUse)
+        {
+            if (edge.second != 1) continue;
+            locked[edge.first >> 32] = true;
+            locked[edge.first & 0xFFFFFFFFu] = true;
+        }
+    }
+
+    std::vector<Quadric> quadrics(groupCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3& p0 = position[groupOf[indices[i]]];
+        glm::dvec3 n = TriangleNormal(p0, position[groupOf[indices[i + 1]]], position[groupOf[indices[i + 2]]]);
+        double area = glm::length(n);
+        if (area <= 0) continue;
+        n /= area;
+        double d = -glm::dot(n, glm::dvec3(p0));
+        for (int k = 0; k < 3; k++)
+            quadrics[groupOf[indices[i + k]]].AddPlane(n, d, area * 0.5);
+    }
+
+    const double maxCost = double(maxError) * double(maxError);
+    double worstCost = 0.0;
+
+    std::vector<unsigned int> offsets, adjacency, remap(vertices.size());
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(groupCount);
+    while (indices.size() > targetIndexCount)
+    {
+        const size_t triangleCount = indices.size() / 3;
+
+        // Triangles around each group for this pass
+        offsets.assign(groupCount + 1, 0);
+        for (unsigned int index : indices) offsets[groupOf[index] + 1]++;
+        for (unsigned int g = 0; g < groupCount; g++) offsets[g + 1] += offsets[g];
+        adjacency.resize(indices.size());
+        {
+            std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++)
+                for (int k = 0; k < 3; k++)
+                    adjacency[cursor[groupOf[indices[t * 3 + k]]]++] = static_cast<unsigned int>(t);
+        }
+
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = groupOf[indices[t * 3 + k]], b = groupOf[indices[t * 3 + (k + 1) % 3]];
+                if (!locked[a]) collapses.push_back({a, b, quadrics[a].Error(position[b])});
+                if (!locked[b]) collapses.push_back({b, a, quadrics[b].Error(position[a])});
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // Each collapse removes about two triangles; stop short of the target
+        const size_t removeBudget = (indices.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        bool collapsed = false;
+        std::fill(touched.begin(), touched.end(), false);
+        for (size_t v = 0; v < remap.size(); v++) remap[v] = static_cast<unsigned int>(v);
+
+        for (const Collapse& c : collapses)
+        {
+            if (removed >= removeBudget || c.cost > maxCost) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            // Reject collapses that flip or badly skew a surviving triangle,
+            // and find which vertex of the target the collapsed ones map to
+            unsigned int target = ~0u;
+            size_t removedHere = 0;
+            bool valid = true;
+            for (unsigned int j = offsets[c.from]; j < offsets[c.from + 1] && valid; j++)
+            {
+                const unsigned int* tri = &indices[adjacency[j] * 3];
+                unsigned int g[3] = {groupOf[tri[0]], groupOf[tri[1]], groupOf[tri[2]]};
+                if (g[0] == c.to || g[1] == c.to || g[2] == c.to)
+                {
+                    for (int k = 0; k < 3; k++)
+                        if (g[k] == c.to) target = tri[k];
+                    removedHere++;
+                    continue;
+                }
+                glm::vec3 before = TriangleNormal(position[g[0]], position[g[1]], position[g[2]]);
+                glm::vec3 p[3] = {position[g[0]], position[g[1]], position[g[2]]};
+                for (int k = 0; k < 3; k++)
+                    if (g[k] == c.from) p[k] = position[c.to];
+                glm::vec3 after = TriangleNormal(p[0], p[1], p[2]);
+                valid = glm::dot(before, after) >= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if (!valid || target == ~0u) continue;
+
+            for (unsigned int j = offsets[c.from]; j < offsets[c.from + 1]; j++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[adjacency[j] * 3 + k];
+                    touched[groupOf[v]] = true;
+                    if (groupOf[v] == c.from) remap[v] = target;
+                }
+            }
+            quadrics[c.to].Add(quadrics[c.from]);
+            worstCost = std::max(worstCost, c.cost);
+            removed += removedHere;
+            collapsed = true;
+        }
+        if (!collapsed) break;
+
+        // Rewrite and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (groupOf[a] == groupOf[b] || groupOf[b] == groupOf[c] || groupOf[a] == groupOf[c]) continue;
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        indices.resize(write);
+    }
+
+    return static_cast<float>(std::sqrt(worstCost));
+}
+
+std::vector<MeshLod> MeshSimplifier::BuildLodChain(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    PROFILE_CPU_SCOPE("MeshSimplifier::BuildLodChain");
+    std::vector<MeshLod> lods;
+    lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+    if (indices.size() % 3 != 0) return lods;
+
+    std::vector<unsigned int> current(indices);
+    float error = 0.0f;
+    for (unsigned int level = 1; level < kMaxLods; level++)
+    {
+        const size_t target = (current.size() / 3 / 2) * 3;
+        if (target < kMinLodTriangles * 3) break;
+
+        std::vector<unsigned int> next(current);
+        // Each level is measured against the one before, so errors add up
+        error += Simplify(vertices, next, target);
+        if (float(next.size()) > float(current.size()) * (1.0f - kMinLodReduction)) break;
+
+        MeshOptimizer::OptimizeVertexCache(next, vertices.size());
+        lods.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(next.size()), error});
+        indices.insert(indices.end(), next.begin(), next.end());
+        current.swap(next);
+    }
+    return lods;
+}
+
+unsigned int MeshSimplifier::SelectLod(const std::vector<float>& errors, unsigned int maxLevel, float pixelsPerUnit,
+                                       float threshold, int current, float hysteresis)
+{
+    if (errors.size() < 2) return 0;
+    auto pixels = [&](size_t level) { return errors[level] * pixelsPerUnit; };
+
+    const size_t lastLevel = std::min<size_t>(errors.size() - 1, maxLevel);
+    size_t level = 0;
+    while (level < lastLevel && pixels(level + 1) <= threshold)
+        ++level;
+    if (current < 0) return static_cast<unsigned int>(level);
+
+    const size_t previous = std::min<size_t>(static_cast<size_t>(current), lastLevel);
+    if (level > previous)
+    {
+        // Coarser only once the new level is comfortably under the threshold
+        while (level > previous && pixels(level) > threshold * (1.0f - hysteresis))
+            --level;
+    }
+    else if (level < previous && pixels(previous) <= threshold * (1.0f + hysteresis))
+    {
+        // Finer only once the current level is clearly over it
+        level = previous;
+    }
+    return static_cast<unsigned int>(level);
+}
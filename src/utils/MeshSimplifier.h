@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+#include "RenderTypes.h"
+
+// Quadric edge-collapse simplification for building LOD chains at import.
+// Collapses move a vertex onto a neighbour (no new vertices), so every LOD
+// indexes the original vertex buffer.
+class MeshSimplifier {
+public:
+    static constexpr unsigned int kMaxLods = 4;
+
+    // Collapses edges until at most targetIndexCount indices are left or the
+    // next collapse would move the surface by more than maxError. Vertices on
+    // UV/normal seams and open borders never move, so seams stay intact.
+    // Returns the largest error introduced, in object-space units.
+    static float Simplify(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+                          size_t targetIndexCount, float maxError = FLT_MAX);
+
+    // Appends LODs 1..n to indices, each with roughly half the triangles of
+    // the one before, and returns all levels including LOD 0. Stops early
+    // when the mesh no longer simplifies.
+    static std::vector<MeshLod> BuildLodChain(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+    // Coarsest level up to maxLevel whose error, at pixelsPerUnit pixels per
+    // object-space unit, stays under threshold pixels. With current (last
+    // frame's level, or -1) the level only moves once the error is
+    // hysteresis * threshold past it, so it does not flicker at the boundary.
+    static unsigned int SelectLod(const std::vector<float>& errors, unsigned int maxLevel, float pixelsPerUnit,
+                                  float threshold, int current = -1, float hysteresis = 0.0f);
+};
@@ -1,41 +1,221 @@
 #include "Model.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include "stb_image.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include <assimp/GltfMaterial.h>
 #include <filesystem>
 #include <iostream>
 
-Model::Model(std::string const &path, const char* vsPath, const char* fsPath, bool gamma)
-    : gammaCorrection(gamma)
+static constexpr UniformHandle kModelUniform("model");
+
+// Encoded bytes of an embedded texture, sized the way stb_image is handed them
+static MeshCacheImage EmbeddedImage(const aiTexture* texture)
 {
-    modelShader = new Shader(vsPath, fsPath);
-    loadModel(path);
+    MeshCacheImage image;
+    image.data = texture->pcData;
+    image.size = texture->mHeight == 0 ? texture->mWidth : size_t(texture->mWidth) * texture->mHeight;
+    return image;
+}
+
+// The freshly imported model as a cache entry, borrowing its CPU data. False,
+// with a message, for models the cache cannot describe.
+static bool DescribeForCache(const Model& model, const aiScene* scene, const std::string& path, MeshCacheContents& contents)
+{
+    contents.flags = model.isTransparent ? static_cast<uint32_t>(MESH_CACHE_TRANSPARENT) : 0u;
+    contents.vertexStreams = model.vertexStreams;
+    for (const Texture& texture : model.textures_loaded)
+    {
+        MeshCacheTextureData data;
+        data.type = texture.type;
+        data.path = texture.path;
+        if (const aiTexture* embedded = scene->GetEmbeddedTexture(texture.path.c_str()))
+            data.image = EmbeddedImage(embedded);
+        contents.textures.push_back(std::move(data));
+    }
+
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        const Mesh& mesh = model.meshes[i];
+        MeshCacheMeshData data;
+        data.drawMode = mesh.drawMode;
+        data.doubleSided = mesh.doubleSided;
+        data.bounds = mesh.bounds;
+        data.boundingSphere = mesh.boundingSphere;
+        for (const Texture& texture : mesh.textures)
+        {
+            uint32_t t = 0;
+            while (t < model.textures_loaded.size() && model.textures_loaded[t].id != texture.id) t++;
+            if (t == model.textures_loaded.size())
+            {
+                std::cout << "ERROR::MESH_CACHE::UNCACHEABLE_TEXTURE: " << path << std::endl;
+                return false;
+            }
+            data.textures.push_back(t);
+        }
+
+        for (size_t k = 0; k < i && data.sharedWith < 0; k++)
+            if (model.meshes[k].geometry.SharesWith(mesh.geometry)) data.sharedWith = static_cast<int32_t>(k);
+        if (data.sharedWith < 0)
+        {
+            // Custom vertex types and released CPU data cannot be described
+            if (!mesh.layout || !FindVertexFormat(*mesh.layout, data.vertexFormat) || mesh.positions.empty())
+            {
+                std::cout << "ERROR::MESH_CACHE::UNCACHEABLE_MESH: " << path << std::endl;
+                return false;
+            }
+            data.vertexData = mesh.vertexData.data();
+            data.vertexDataSize = mesh.vertexData.size();
+            data.positions = mesh.positions.data();
+            data.vertexCount = static_cast<uint32_t>(mesh.positions.size());
+            data.indices = mesh.indices.data();
+            data.indexCount = static_cast<uint32_t>(mesh.indices.size());
+            data.lods = mesh.lods.data();
+            data.lodCount = static_cast<uint32_t>(mesh.lods.size());
+            data.meshlets = mesh.meshlets.data();
+            data.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+        }
+        contents.meshes.push_back(std::move(data));
+    }
+    return true;
 }
 
-Model::Model(std::vector<Mesh> customMeshes, Shader* shader)
-    : meshes(customMeshes), modelShader(shader), gammaCorrection(false)
+Model::Model(std::string const &path, const char* vsPath, const char* fsPath, bool gamma, uint32_t vertexStreams)
+    : gammaCorrection(gamma), vertexStreams(vertexStreams), shaderVariants(vsPath, fsPath)
 {
+    selectShaders(SHADER_FEATURE_TEXTURED);
+    loadModel(path);
+    computeBounds();
+}
 
+Model::Model(std::vector<Mesh> customMeshes, const char* vsPath, const char* fsPath, uint32_t shaderFeatures)
+    : meshes(std::move(customMeshes)), gammaCorrection(false), shaderVariants(vsPath, fsPath)
+{
+    selectShaders(shaderFeatures);
+    computeBounds();
 }
 
 Model::~Model()
 {
-    if (modelShader) delete modelShader;
+    // Before the cache mapping goes: their uploads may still read it
+    meshes.clear();
+    for (const Texture& texture : textures_loaded)
+        GLState::DeleteTexture(texture.id);
+}
+
+void Model::ReleaseCpuData()
+{
+    for (Mesh& mesh : meshes)
+        mesh.ReleaseCpuData();
+    cache.reset();
+}
+
+bool Model::IsResident() const
+{
+    for (const Mesh& mesh : meshes)
+        if (!mesh.IsResident()) return false;
+    return true;
+}
+
+void Model::selectShaders(uint32_t shaderFeatures)
+{
+    // Only these two permutations are ever compiled for a model
+    modelShader = &shaderVariants.Get(shaderFeatures);
+    instancedShader = &shaderVariants.Get(shaderFeatures | SHADER_FEATURE_INSTANCED);
 }
 
-void Model::Draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection)
+// Render thread only, like everything that draws
+static std::vector<IndexRange> s_VisibleRanges;
+
+void Model::Draw(const glm::mat4& model, unsigned int lod, MeshletCullView* view)
 {
+    PROFILE_SCOPE("Model::Draw");
     if (!modelShader) return;
 
     modelShader->use();
-    modelShader->setMat4("projection", projection);
-    modelShader->setMat4("view", view);
-    modelShader->setMat4("model", model);
+    modelShader->setMat4(kModelUniform, model);
+
+    for (Mesh& mesh : meshes)
+    {
+        if (view && mesh.UsesMeshlets(lod))
+        {
+            s_VisibleRanges.clear();
+            CullMeshlets(mesh.meshlets, *view, !mesh.doubleSided, s_VisibleRanges);
+            mesh.DrawRanges(*modelShader, s_VisibleRanges);
+        }
+        else
+        {
+            mesh.Draw(*modelShader, lod);
+        }
+    }
+}
+
+void Model::DrawInstanced(unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod)
+{
+    PROFILE_SCOPE("Model::DrawInstanced");
+    if (!instancedShader) return;
+
+    instancedShader->use();
 
     for(unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(*modelShader);
+        meshes[i].DrawInstanced(*instancedShader, instanceBuffer, byteOffset, instanceCount, lod);
+}
+
+void Model::DrawDepth(Shader& depthShader, const glm::mat4& model, unsigned int lod, MeshletCullView* view)
+{
+    depthShader.use();
+    depthShader.setMat4(kModelUniform, model);
+
+    for (Mesh& mesh : meshes)
+    {
+        if (view && mesh.UsesMeshlets(lod))
+        {
+            s_VisibleRanges.clear();
+            CullMeshlets(mesh.meshlets, *view, !mesh.doubleSided, s_VisibleRanges);
+            mesh.DrawDepthRanges(s_VisibleRanges);
+        }
+        else
+        {
+            mesh.DrawDepth(lod);
+        }
+    }
+}
+
+void Model::DrawDepthInstanced(Shader& depthShader, unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod)
+{
+    depthShader.use();
+
+    for (Mesh& mesh : meshes)
+        mesh.DrawDepthInstanced(instanceBuffer, byteOffset, instanceCount, lod);
+}
+
+void Model::computeBounds()
+{
+    bounds = AABB();
+    lodErrors.assign(1, 0.0f);
+    for (const Mesh& mesh : meshes)
+    {
+        bounds.Expand(mesh.bounds);
+        if (mesh.lods.size() > lodErrors.size()) lodErrors.resize(mesh.lods.size(), 0.0f);
+    }
+    // A mesh past its last level keeps drawing that level, so its error counts for every coarser one
+    for (size_t level = 1; level < lodErrors.size(); level++)
+        for (const Mesh& mesh : meshes)
+            lodErrors[level] = std::max(lodErrors[level], mesh.Lod(static_cast<unsigned int>(level)).error);
 }
 
 void Model::loadModel(std::string const &path)
 {
+    PROFILE_CPU_SCOPE("Model::loadModel");
+    directory = std::filesystem::path(path).parent_path().string();
+    if (std::unique_ptr<MeshCache> cached = MeshCache::Open(path, vertexStreams))
+    {
+        loadFromCache(std::move(cached));
+        return;
+    }
+
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
 
@@ -46,18 +226,82 @@ void Model::loadModel(std::string const &path)
     }
 
     scene_ptr = scene;
-    directory = std::filesystem::path(path).parent_path().string();
-
     processNode(scene->mRootNode, scene);
+
+    MeshCacheContents contents;
+    if (DescribeForCache(*this, scene, path, contents))
+        MeshCache::Write(path, contents);
     scene_ptr = nullptr;
+    importedByIndex.clear();
+    importedByHash.clear();
+}
+
+void Model::loadFromCache(std::unique_ptr<MeshCache> cached)
+{
+    PROFILE_CPU_SCOPE("Model::loadFromCache");
+    const MeshCacheHeader& header = cached->Header();
+    isTransparent = (header.flags & MESH_CACHE_TRANSPARENT) != 0;
+
+    for (uint32_t i = 0; i < header.textureCount; i++)
+    {
+        const MeshCacheTexture& record = cached->TextureRecord(i);
+        Texture texture;
+        texture.type = cached->String(record.typeOffset, record.typeLength);
+        texture.path = cached->String(record.pathOffset, record.pathLength);
+        texture.id = record.imageSize > 0
+            ? TextureFromMemory(cached->At<unsigned char>(record.imageOffset), static_cast<int>(record.imageSize))
+            : TextureFromFile(texture.path.c_str(), directory);
+        textures_loaded.push_back(texture);
+    }
+
+    meshes.reserve(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+        const MeshCacheMesh& record = cached->MeshRecord(i);
+        std::vector<Texture> textures;
+        const uint32_t* textureIndices = cached->At<uint32_t>(record.texturesOffset);
+        for (uint32_t t = 0; t < record.textureCount; t++)
+            textures.push_back(textures_loaded[textureIndices[t]]);
+
+        if (record.sharedWith >= 0)
+        {
+            Mesh shared = Mesh::ShareGeometry(meshes[record.sharedWith], std::move(textures));
+            shared.doubleSided = record.doubleSided != 0;
+            meshes.push_back(std::move(shared));
+            continue;
+        }
+
+        const MeshLod* lods = cached->At<MeshLod>(record.lodsOffset);
+        const Meshlet* meshlets = cached->At<Meshlet>(record.meshletsOffset);
+        Mesh mesh(GetVertexLayout(record.vertexFormat), cached->At<uint8_t>(record.vertexDataOffset),
+                  cached->At<glm::vec3>(record.positionsOffset), record.vertexCount,
+                  cached->At<unsigned int>(record.indicesOffset), record.indexCount, std::move(textures), record.drawMode,
+                  std::vector<MeshLod>(lods, lods + record.lodCount), std::vector<Meshlet>(meshlets, meshlets + record.meshletCount),
+                  record.bounds, record.boundingSphere);
+        mesh.doubleSided = record.doubleSided != 0;
+        meshes.push_back(std::move(mesh));
+    }
+    cache = std::move(cached);
 }
 
 void Model::processNode(aiNode *node, const aiScene *scene)
 {
     for(unsigned int i = 0; i < node->mNumMeshes; i++)
     {
+        // Node transforms are not applied, so another reference only needs another Mesh over the same range
+        auto imported = importedByIndex.find(node->mMeshes[i]);
+        if (imported != importedByIndex.end())
+        {
+            const Mesh& source = meshes[imported->second];
+            Mesh instance = Mesh::ShareGeometry(source, source.textures);
+            meshes.push_back(std::move(instance));
+            continue;
+        }
+
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        Mesh result = processMesh(mesh, scene);
+        importedByIndex[node->mMeshes[i]] = meshes.size();
+        meshes.push_back(std::move(result));
     }
     for(unsigned int i = 0; i < node->mNumChildren; i++)
     {
@@ -70,6 +314,8 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
+    // Formats that do not say are drawn without face culling, as before
+    bool doubleSided = true;
 
     // 1. Vertices
     for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -118,11 +364,51 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
     // 3. Material Textures
     if(mesh->mMaterialIndex >= 0) {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+        float opacity = 1.0f;
+        aiString alphaMode;
+        if ((material->Get(AI_MATKEY_OPACITY, opacity) == AI_SUCCESS && opacity < 1.0f) ||
+            (material->Get(AI_MATKEY_GLTF_ALPHAMODE, alphaMode) == AI_SUCCESS && std::strcmp(alphaMode.C_Str(), "BLEND") == 0))
+            isTransparent = true;
+
+        int twoSided = 1;
+        if (material->Get(AI_MATKEY_TWOSIDED, twoSided) == AI_SUCCESS)
+            doubleSided = twoSided != 0;
+
         std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
     }
 
-    return Mesh(vertices, indices, textures);
+    // Stands in for aiProcess_JoinIdenticalVertices, which loadModel does not request
+    MeshOptimizer::WeldVertices(vertices, indices);
+
+    // Another aiMesh with the same data (typically the same part with another
+    // material) shares the first one's GPU range. The hash only finds the
+    // candidates; the welded data is compared before anything is shared.
+    const uint64_t hash = MeshOptimizer::HashGeometry(vertices, indices);
+    auto candidates = importedByHash.equal_range(hash);
+    for (auto it = candidates.first; it != candidates.second; ++it)
+    {
+        const ImportedGeometry& imported = it->second;
+        if (imported.vertices.size() != vertices.size() || imported.indices.size() != indices.size() ||
+            std::memcmp(imported.vertices.data(), vertices.data(), vertices.size() * sizeof(Vertex)) != 0 ||
+            std::memcmp(imported.indices.data(), indices.data(), indices.size() * sizeof(unsigned int)) != 0)
+            continue;
+        Mesh shared = Mesh::ShareGeometry(meshes[imported.mesh], std::move(textures));
+        shared.doubleSided = doubleSided;
+        return shared;
+    }
+    // processNode appends this mesh next
+    importedByHash.emplace(hash, ImportedGeometry{meshes.size(), vertices, indices});
+
+    // Assimp's triangle order is whatever the exporter wrote
+    MeshOptimizer::Optimize(vertices, indices);
+    std::vector<MeshLod> lods = MeshSimplifier::BuildLodChain(vertices, indices);
+    std::vector<Meshlet> meshlets = MeshOptimizer::BuildMeshlets(vertices, indices, lods[0].indexCount);
+    Mesh result(std::move(vertices), std::move(indices), std::move(textures), GL_TRIANGLES, std::move(lods), std::move(meshlets),
+                vertexStreams);
+    result.doubleSided = doubleSided;
+    return result;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
@@ -150,7 +436,8 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType
             const aiTexture* embeddedTex = scene_ptr->GetEmbeddedTexture(str.C_Str());
 
             if (embeddedTex) {
-                texture.id = TextureFromMemory(embeddedTex);
+                MeshCacheImage image = EmbeddedImage(embeddedTex);
+                texture.id = TextureFromMemory(static_cast<const unsigned char*>(image.data), static_cast<int>(image.size));
             } else {
                 texture.id = TextureFromFile(str.C_Str(), this->directory);
             }
@@ -164,7 +451,7 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType
     return textures;
 }
 
-unsigned int Model::TextureFromMemory(const aiTexture* aiTex)
+unsigned int Model::TextureFromMemory(const unsigned char* bytes, int size)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
@@ -172,10 +459,7 @@ unsigned int Model::TextureFromMemory(const aiTexture* aiTex)
     int width, height, nrComponents;
     unsigned char *data = nullptr;
 
-    if (aiTex->mHeight == 0)
-        data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(aiTex->pcData), aiTex->mWidth, &width, &height, &nrComponents, 0);
-    else
-        data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(aiTex->pcData), aiTex->mWidth * aiTex->mHeight, &width, &height, &nrComponents, 0);
+    data = stbi_load_from_memory(bytes, size, &width, &height, &nrComponents, 0);
 
     if (data)
     {
@@ -184,7 +468,7 @@ unsigned int Model::TextureFromMemory(const aiTexture* aiTex)
         else if (nrComponents == 3) format = GL_RGB;
         else if (nrComponents == 4) format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::BindTexture(0, GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -219,7 +503,7 @@ unsigned int Model::TextureFromFile(const char *path, const std::string &directo
         else if (nrComponents == 3) format = GL_RGB;
         else if (nrComponents == 4) format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::BindTexture(0, GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
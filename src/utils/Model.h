@@ -9,37 +9,96 @@
 #include <assimp/postprocess.h>
 #include "Mesh.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "RenderTypes.h"
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+class MeshCache;
+
 class Model
 {
 public:
+    // Textures this model created and deletes; meshes only reference them
     std::vector<Texture> textures_loaded;
     std::vector<Mesh>    meshes;
     std::string directory;
     bool gammaCorrection;
+    // Drawn in the blended pass, back-to-front
+    bool isTransparent = false;
+    // Opaque models go through the depth pre-pass when it is on. Clear this
+    // for vertex shaders that do not transform positions exactly like mesh.vs.
+    bool depthPrepass = true;
+    // Streams beyond position and uv the vertex shader reads (kVertexStreamFlags).
+    // Imported meshes carry them where they have the data, and nothing else.
+    uint32_t vertexStreams = 0;
 
+    // Programs come from the ShaderLibrary, so models with the same shader pair share them
+    ShaderVariants shaderVariants;
     Shader* modelShader;
+    // Same features plus SHADER_FEATURE_INSTANCED, for DrawInstanced and indirect draws
+    Shader* instancedShader;
 
-    Model(std::string const &path, const char* vsPath, const char* fsPath, bool gamma = false);
+    // Union of all mesh bounds in model space
+    AABB bounds;
+    // Per LOD level, the largest error of any mesh at that level (model
+    // space). Meshes with fewer levels stay at their coarsest one.
+    std::vector<float> lodErrors;
 
-    Model(std::vector<Mesh> customMeshes, Shader* shader);
+    // Loaded models are drawn with the SHADER_FEATURE_TEXTURED variant. A
+    // MeshCache entry for path and vertexStreams is used when there is a
+    // current one, and written after importing with Assimp otherwise.
+    Model(std::string const &path, const char* vsPath, const char* fsPath, bool gamma = false, uint32_t vertexStreams = 0);
 
+    // Takes the meshes over; pass them with std::move
+    Model(std::vector<Mesh> customMeshes, const char* vsPath, const char* fsPath, uint32_t shaderFeatures = 0);
     ~Model();
 
-    void Draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection);
+    // The Renderer keeps Model pointers, so models stay where they were made
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // Frees every mesh's CPU vertex/index copies, or the cache mapping they
+    // were uploaded from, once nothing needs them anymore
+    void ReleaseCpuData();
+    // True once every mesh's geometry upload has landed
+    bool IsResident() const;
+
+    // View/projection come from the CameraData uniform block the Renderer uploads
+    // With a view, LOD 0 meshes that have meshlets draw only the clusters that survive culling
+    void Draw(const glm::mat4& model, unsigned int lod = 0, MeshletCullView* view = nullptr);
+    void DrawInstanced(unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod = 0);
+    // Depth pre-pass: positions only, with the caller's depth shader
+    void DrawDepth(Shader& depthShader, const glm::mat4& model, unsigned int lod = 0, MeshletCullView* view = nullptr);
+    void DrawDepthInstanced(Shader& depthShader, unsigned int instanceBuffer, GLintptr byteOffset, GLsizei instanceCount, unsigned int lod = 0);
 
 private:
     const aiScene* scene_ptr = nullptr;
+    // Welded data of an imported mesh, compared on a hash match before sharing
+    struct ImportedGeometry {
+        size_t mesh;
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+    // Import only: meshes already built, by aiMesh index (several nodes may
+    // reference one) and by MeshOptimizer::HashGeometry of the welded data
+    std::unordered_map<unsigned int, size_t> importedByIndex;
+    std::unordered_multimap<uint64_t, ImportedGeometry> importedByHash;
+    // Mapping meshes loaded from the cache upload from; kept until ReleaseCpuData
+    std::unique_ptr<MeshCache> cache;
+
+    void selectShaders(uint32_t shaderFeatures);
 
     void loadModel(std::string const &path);
+    void loadFromCache(std::unique_ptr<MeshCache> cached);
+    void computeBounds();
     void processNode(aiNode *node, const aiScene *scene);
     Mesh processMesh(aiMesh *mesh, const aiScene *scene);
     std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName);
     
-    unsigned int TextureFromMemory(const aiTexture* aiTex);
+    unsigned int TextureFromMemory(const unsigned char* data, int size);
     unsigned int TextureFromFile(const char *path, const std::string &directory);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,363 @@
+#include "Profiler.h"
+#include <imgui/imgui.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Frames recorded but not yet read back; results are expected after two
+static constexpr int kFramesInFlight = 3;
+static constexpr size_t kHistoryFrames = 300;
+// Beyond this a frame's scopes are CPU-only, to bound query objects
+static constexpr size_t kMaxGpuScopesPerFrame = 1024;
+
+struct ScopeRecord
+{
+    const char* name;
+    int parent;
+    int depth;
+    int64_t cpuBegin, cpuEnd;   // ns
+    int gpuBegin, gpuEnd;       // query indices, -1 if CPU-only
+    int64_t gpuBeginNs, gpuEndNs;
+};
+
+struct FrameRecord
+{
+    uint64_t index = 0;
+    int64_t cpuBegin = 0, cpuEnd = 0;
+    // GPU timestamp minus CPU time at frame start, to put both on one timeline
+    int64_t gpuToCpu = 0;
+    bool gpuValid = false;
+    bool pending = false;
+    std::vector<ScopeRecord> scopes;
+    std::vector<GLuint> queries;
+    size_t queriesUsed = 0;
+    // GPU scopes recorded CPU-only because the frame hit kMaxGpuScopesPerFrame
+    uint32_t gpuScopesDropped = 0;
+};
+
+struct ProfilerData
+{
+    bool enabled = true;
+    uint64_t frameIndex = 0;
+    int currentSlot = 0;
+    FrameRecord inFlight[kFramesInFlight];
+    std::vector<int> scopeStack;
+
+    // Resolved frames, oldest overwritten first; vectors are reused
+    FrameRecord history[kHistoryFrames];
+    size_t historyCount = 0;
+    size_t historyHead = 0;
+    int latest = -1;
+};
+
+static ProfilerData s_Profiler;
+
+static int64_t NowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static FrameRecord& CurrentFrame()
+{
+    return s_Profiler.inFlight[s_Profiler.currentSlot];
+}
+
+static GLuint NextQuery(FrameRecord& frame)
+{
+    if (frame.queriesUsed == frame.queries.size())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    return frame.queries[frame.queriesUsed++];
+}
+
+static void StartFrame(FrameRecord& frame)
+{
+    frame.index = s_Profiler.frameIndex;
+    frame.cpuBegin = NowNs();
+    frame.cpuEnd = frame.cpuBegin;
+    frame.gpuValid = false;
+    frame.pending = false;
+    frame.scopes.clear();
+    frame.queriesUsed = 0;
+    frame.gpuScopesDropped = 0;
+
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    frame.gpuToCpu = gpuNow - frame.cpuBegin;
+    s_Profiler.scopeStack.clear();
+}
+
+static void PushHistory(const FrameRecord& frame)
+{
+    FrameRecord& slot = s_Profiler.history[s_Profiler.historyHead];
+    slot.index = frame.index;
+    slot.cpuBegin = frame.cpuBegin;
+    slot.cpuEnd = frame.cpuEnd;
+    slot.gpuToCpu = frame.gpuToCpu;
+    slot.gpuValid = frame.gpuValid;
+    slot.gpuScopesDropped = frame.gpuScopesDropped;
+    slot.scopes.assign(frame.scopes.begin(), frame.scopes.end());
+
+    s_Profiler.latest = static_cast<int>(s_Profiler.historyHead);
+    s_Profiler.historyHead = (s_Profiler.historyHead + 1) % kHistoryFrames;
+    if (s_Profiler.historyCount < kHistoryFrames) s_Profiler.historyCount++;
+}
+
+// Reads back a finished frame's queries if the GPU is done with them
+static bool TryResolve(FrameRecord& frame, bool force)
+{
+    if (frame.queriesUsed > 0)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.queriesUsed - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available && !force) return false;
+
+        if (available)
+        {
+            for (ScopeRecord& scope : frame.scopes)
+            {
+                if (scope.gpuBegin < 0) continue;
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(frame.queries[scope.gpuBegin], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(frame.queries[scope.gpuEnd], GL_QUERY_RESULT, &end);
+                scope.gpuBeginNs = static_cast<int64_t>(begin);
+                scope.gpuEndNs = static_cast<int64_t>(end);
+            }
+            frame.gpuValid = true;
+        }
+    }
+
+    frame.pending = false;
+    PushHistory(frame);
+    return true;
+}
+
+void Profiler::BeginFrame()
+{
+    if (!s_Profiler.enabled) return;
+
+    s_Profiler.currentSlot = static_cast<int>(s_Profiler.frameIndex % kFramesInFlight);
+    FrameRecord& frame = CurrentFrame();
+    // Too late for this one: keep its CPU times, drop the GPU ones rather than wait
+    if (frame.pending) TryResolve(frame, true);
+    StartFrame(frame);
+}
+
+void Profiler::EndFrame()
+{
+    if (!s_Profiler.enabled) return;
+
+    FrameRecord& frame = CurrentFrame();
+    while (!s_Profiler.scopeStack.empty())
+        EndScope();
+    frame.cpuEnd = NowNs();
+    frame.pending = true;
+    s_Profiler.frameIndex++;
+
+    // Oldest first, so history stays in frame order
+    for (int i = 1; i <= kFramesInFlight; ++i)
+    {
+        FrameRecord& older = s_Profiler.inFlight[(s_Profiler.currentSlot + i) % kFramesInFlight];
+        if (older.pending && !TryResolve(older, false)) break;
+    }
+}
+
+void Profiler::Shutdown()
+{
+    for (FrameRecord& frame : s_Profiler.inFlight)
+    {
+        if (!frame.queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        frame.queries.clear();
+        frame.queriesUsed = 0;
+        frame.pending = false;
+    }
+}
+
+void Profiler::BeginScope(const char* name, bool gpu)
+{
+    if (!s_Profiler.enabled) return;
+
+    FrameRecord& frame = CurrentFrame();
+    ScopeRecord scope;
+    scope.name = name;
+    scope.parent = s_Profiler.scopeStack.empty() ? -1 : s_Profiler.scopeStack.back();
+    scope.depth = static_cast<int>(s_Profiler.scopeStack.size());
+    scope.cpuBegin = NowNs();
+    scope.cpuEnd = scope.cpuBegin;
+    scope.gpuBegin = scope.gpuEnd = -1;
+    scope.gpuBeginNs = scope.gpuEndNs = 0;
+
+    if (gpu && frame.queriesUsed / 2 < kMaxGpuScopesPerFrame)
+    {
+        scope.gpuBegin = static_cast<int>(frame.queriesUsed);
+        glQueryCounter(NextQuery(frame), GL_TIMESTAMP);
+    }
+    else if (gpu)
+    {
+        frame.gpuScopesDropped++;
+    }
+
+    s_Profiler.scopeStack.push_back(static_cast<int>(frame.scopes.size()));
+    frame.scopes.push_back(scope);
+}
+
+void Profiler::EndScope()
+{
+    if (!s_Profiler.enabled || s_Profiler.scopeStack.empty()) return;
+
+    FrameRecord& frame = CurrentFrame();
+    ScopeRecord& scope = frame.scopes[s_Profiler.scopeStack.back()];
+    s_Profiler.scopeStack.pop_back();
+
+    if (scope.gpuBegin >= 0)
+    {
+        scope.gpuEnd = static_cast<int>(frame.queriesUsed);
+        glQueryCounter(NextQuery(frame), GL_TIMESTAMP);
+    }
+    scope.cpuEnd = NowNs();
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+    if (s_Profiler.enabled == enabled) return;
+    s_Profiler.enabled = enabled;
+    s_Profiler.scopeStack.clear();
+    for (FrameRecord& frame : s_Profiler.inFlight)
+        frame.pending = false;
+}
+
+bool Profiler::IsEnabled()
+{
+    return s_Profiler.enabled;
+}
+
+static void DrawScopeRow(const FrameRecord& frame, int index)
+{
+    const ScopeRecord& scope = frame.scopes[index];
+
+    // Children are the following scopes whose parent is this one
+    bool hasChildren = false;
+    for (size_t i = index + 1; i < frame.scopes.size() && frame.scopes[i].depth > scope.depth; ++i)
+    {
+        if (frame.scopes[i].parent == index)
+        {
+            hasChildren = true;
+            break;
+        }
+    }
+
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_DefaultOpen;
+    if (!hasChildren) flags |= ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+    bool open = ImGui::TreeNodeEx((void*)(intptr_t)index, flags, "%s", scope.name);
+
+    ImGui::TableNextColumn();
+    ImGui::Text("%.3f", (scope.cpuEnd - scope.cpuBegin) / 1e6);
+    ImGui::TableNextColumn();
+    if (scope.gpuBegin >= 0 && frame.gpuValid) ImGui::Text("%.3f", (scope.gpuEndNs - scope.gpuBeginNs) / 1e6);
+    else ImGui::TextDisabled("-");
+
+    if (hasChildren && open)
+    {
+        for (size_t i = index + 1; i < frame.scopes.size() && frame.scopes[i].depth > scope.depth; ++i)
+            if (frame.scopes[i].parent == index)
+                DrawScopeRow(frame, static_cast<int>(i));
+        ImGui::TreePop();
+    }
+}
+
+void Profiler::DrawImGui()
+{
+    ImGui::Begin("Profiler");
+
+    bool enabled = s_Profiler.enabled;
+    if (ImGui::Checkbox("Enabled", &enabled)) SetEnabled(enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Export trace"))
+    {
+        if (ExportChromeTrace("profile_trace.json"))
+            std::cout << "Profiler trace written to profile_trace.json" << std::endl;
+    }
+
+    if (s_Profiler.latest >= 0)
+    {
+        const FrameRecord& frame = s_Profiler.history[s_Profiler.latest];
+        ImGui::Text("Frame %llu: %.3f ms CPU", (unsigned long long)frame.index, (frame.cpuEnd - frame.cpuBegin) / 1e6);
+        // Every Model::Draw opens its own scope, so large scenes run out of queries
+        if (frame.gpuScopesDropped > 0)
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "GPU timing truncated: %u scopes over the %zu-scope cap",
+                               frame.gpuScopesDropped, kMaxGpuScopesPerFrame);
+
+        if (ImGui::BeginTable("scopes", 3, ImGuiTableFlags_BordersV | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable))
+        {
+            ImGui::TableSetupColumn("Scope", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("CPU ms", ImGuiTableColumnFlags_WidthFixed, 60.0f);
+            ImGui::TableSetupColumn("GPU ms", ImGuiTableColumnFlags_WidthFixed, 60.0f);
+            ImGui::TableHeadersRow();
+            for (size_t i = 0; i < frame.scopes.size(); ++i)
+                if (frame.scopes[i].parent < 0)
+                    DrawScopeRow(frame, static_cast<int>(i));
+            ImGui::EndTable();
+        }
+    }
+
+    ImGui::End();
+}
+
+static void WriteJsonString(std::ofstream& out, const char* text)
+{
+    out << '"';
+    for (const char* c = text; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+bool Profiler::ExportChromeTrace(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cout << "ERROR::PROFILER::CANNOT_WRITE_TRACE: " << path << std::endl;
+        return false;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+    size_t first = (s_Profiler.historyHead + kHistoryFrames - s_Profiler.historyCount) % kHistoryFrames;
+    int64_t origin = s_Profiler.historyCount ? s_Profiler.history[first].cpuBegin : 0;
+    auto emit = [&](const char* name, int tid, int64_t beginNs, int64_t endNs) {
+        out << ",\n{\"name\":";
+        WriteJsonString(out, name);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+            << ",\"ts\":" << (beginNs - origin) / 1000.0
+            << ",\"dur\":" << (endNs - beginNs) / 1000.0 << "}";
+    };
+
+    for (size_t n = 0; n < s_Profiler.historyCount; ++n)
+    {
+        const FrameRecord& frame = s_Profiler.history[(first + n) % kHistoryFrames];
+        emit("Frame", 1, frame.cpuBegin, frame.cpuEnd);
+        for (const ScopeRecord& scope : frame.scopes)
+        {
+            emit(scope.name, 1, scope.cpuBegin, scope.cpuEnd);
+            if (scope.gpuBegin >= 0 && frame.gpuValid)
+                emit(scope.name, 2, scope.gpuBeginNs - frame.gpuToCpu, scope.gpuEndNs - frame.gpuToCpu);
+        }
+    }
+    out << "\n]}\n";
+    return true;
+}
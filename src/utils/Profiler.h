@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// Hierarchical CPU/GPU frame profiler.
+//
+// CPU time comes from steady_clock. GPU time comes from glQueryCounter
+// timestamps around each scope (GL_TIME_ELAPSED queries cannot nest).
+// Queries of a frame are only read back a few frames later, once
+// GL_QUERY_RESULT_AVAILABLE says so, so the profiler never stalls the
+// pipeline. A frame whose results are not ready in time just loses its GPU
+// numbers.
+//
+// Scopes must open and close on the GL thread, and names must outlive the
+// profiler (string literals).
+class Profiler {
+public:
+    static void BeginFrame();
+    static void EndFrame();
+    static void Shutdown();
+
+    static void BeginScope(const char* name, bool gpu = true);
+    static void EndScope();
+
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled();
+
+    // Timing tree of the most recently resolved frame. Scopes past the per-frame
+    // GPU query cap show CPU time only, and the view says how many there were.
+    static void DrawImGui();
+    // Writes the recorded frame history in Chrome's trace event format
+    // (chrome://tracing, Perfetto)
+    static bool ExportChromeTrace(const std::string& path);
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name, bool gpu = true) { Profiler::BeginScope(name, gpu); }
+    ~ProfileScope() { Profiler::EndScope(); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// CPU and GPU timing for the rest of the enclosing block
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name, true)
+// CPU timing only, for code that issues no GL work (e.g. asset parsing)
+#define PROFILE_CPU_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name, false)
@@ -0,0 +1,142 @@
+#include "ProgramBinaryCache.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+static constexpr uint32_t kCacheMagic = 0x42505247; // "GRPB"
+static constexpr uint32_t kCacheVersion = 1;
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static std::string s_CacheDirectory = "shader_cache";
+
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    // 64-bit FNV-1a
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+static uint64_t HashString(uint64_t hash, const std::string& text)
+{
+    // Length first, so ("ab", "c") and ("a", "bc") differ
+    uint64_t length = text.size();
+    hash = HashBytes(hash, &length, sizeof(length));
+    return HashBytes(hash, text.data(), text.size());
+}
+
+static std::string GLString(GLenum name)
+{
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+static std::filesystem::path EntryPath(uint64_t key)
+{
+    char file[32];
+    std::snprintf(file, sizeof(file), "%016llx.bin", static_cast<unsigned long long>(key));
+    return std::filesystem::path(s_CacheDirectory) / file;
+}
+
+bool ProgramBinaryCache::IsSupported()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        GLint formats = 0;
+        if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+    }
+    return supported == 1;
+}
+
+uint64_t ProgramBinaryCache::Key(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = HashBytes(hash, &kCacheVersion, sizeof(kCacheVersion));
+    hash = HashString(hash, GLString(GL_VENDOR));
+    hash = HashString(hash, GLString(GL_RENDERER));
+    hash = HashString(hash, GLString(GL_VERSION));
+    hash = HashString(hash, defines);
+    hash = HashString(hash, vertexSource);
+    hash = HashString(hash, fragmentSource);
+    return hash;
+}
+
+bool ProgramBinaryCache::Load(GLuint program, uint64_t key)
+{
+    if (!IsSupported()) return false;
+
+    std::ifstream file(EntryPath(key), std::ios::binary);
+    if (!file) return false;
+
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != kCacheMagic || header.version != kCacheVersion || header.key != key || header.length == 0)
+        return false;
+
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length)) return false;
+
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(header.length));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+void ProgramBinaryCache::Store(GLuint program, uint64_t key)
+{
+    if (!IsSupported()) return;
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) return;
+
+    std::error_code error;
+    std::filesystem::create_directories(s_CacheDirectory, error);
+
+    // Write under a temporary name so a crash never leaves a truncated entry behind
+    std::filesystem::path path = EntryPath(key);
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER_CACHE::CANNOT_WRITE: " << temp.string() << std::endl;
+            return;
+        }
+        CacheHeader header = {kCacheMagic, kCacheVersion, key, format, static_cast<uint32_t>(written)};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), written);
+        if (!file) return;
+    }
+    std::filesystem::rename(temp, path, error);
+}
+
+void ProgramBinaryCache::SetDirectory(const std::string& directory)
+{
+    s_CacheDirectory = directory;
+}
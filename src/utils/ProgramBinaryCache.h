@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+//
+// Entries are keyed by a hash of the shader sources, the defines they were
+// built with and the driver's vendor/renderer/version strings, so a driver
+// update or an edited shader simply misses. Drivers may still reject a stale
+// binary; callers then compile from source and store the new result.
+class ProgramBinaryCache {
+public:
+    // False if the context cannot save/load program binaries at all
+    static bool IsSupported();
+
+    static uint64_t Key(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines);
+
+    // Links program from the cached binary; false on a miss or if the driver rejects it
+    static bool Load(GLuint program, uint64_t key);
+    // Program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    static void Store(GLuint program, uint64_t key);
+
+    static void SetDirectory(const std::string& directory);
+};
@@ -1,20 +1,106 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cfloat>
+#include <cstdint>
 #include <string>
 
+// A uniform name and its FNV-1a hash. Build these once, ideally as
+// constexpr constants, so per-draw uniform updates do no string work:
+//     static constexpr UniformHandle kModel("model");
+// The name is compared on a table hit, so a handle only keeps the pointer and
+// the string must outlive it; the std::string overload interns its copy.
+struct UniformHandle {
+    uint32_t hash = 0;
+    const char* name = nullptr;
+
+    constexpr UniformHandle() = default;
+    constexpr explicit UniformHandle(const char* name) : hash(Hash(name)), name(name) {}
+    explicit UniformHandle(const std::string& name);
+
+    static constexpr uint32_t Hash(const char* name)
+    {
+        uint32_t h = 2166136261u;
+        for (; *name; ++name)
+            h = (h ^ static_cast<uint8_t>(*name)) * 16777619u;
+        // 0 marks an empty slot in the shader's uniform table
+        return h ? h : 1u;
+    }
+};
+
+// Import-side vertex. Meshes upload it in one of the compact encodings from
+// VertexFormat.h; zeroed fields tell the encoder what can be dropped.
 struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
-    int m_BoneIDs[4];
-    float m_Weights[4];
+    glm::vec3 Position = glm::vec3(0.0f);
+    glm::vec3 Normal = glm::vec3(0.0f);
+    glm::vec2 TexCoords = glm::vec2(0.0f);
+    glm::vec3 Tangent = glm::vec3(0.0f);
+    glm::vec3 Bitangent = glm::vec3(0.0f);
+    int m_BoneIDs[4] = {0, 0, 0, 0};
+    float m_Weights[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 };
 
 struct Texture {
     unsigned int id;
     std::string type;
     std::string path;
+};
+
+// Uniform buffer binding point of the CameraData block every shader declares
+constexpr unsigned int CAMERA_UBO_BINDING = 0;
+
+// Mirrors the std140 CameraData block in the shaders; vec3s are padded to vec4
+struct CameraUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;   // xyz
+    glm::vec4 time;             // x = seconds since start
+};
+
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool Valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extents() const { return (max - min) * 0.5f; }
+
+    void Expand(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void Expand(const AABB& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// One level of detail: a range of the mesh's index list drawn over the same
+// vertices. error is how far (object space) the surface may be from LOD 0.
+struct MeshLod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    float error = 0.0f;
+};
+
+// A small cluster of LOD 0 triangles (a contiguous index range) with
+// bounds for culling it on its own. All in object space.
+struct Meshlet {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    // Every triangle normal is within the cone around coneAxis; coneCutoff
+    // is the sine of its half-angle, 1 when the cone is too wide to cull with
+    glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    float coneCutoff = 1.0f;
 };
\ No newline at end of file
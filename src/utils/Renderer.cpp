@@ -3,45 +3,446 @@
 #include "Camera.h"
 #include "Shader.h"
 #include "Skybox.h"
+#include "LinearArena.h"
+#include "FrustumCulling.h"
+#include "GLState.h"
+#include "GpuRingBuffer.h"
+#include "GeometryArena.h"
+#include "GeometryUploadQueue.h"
+#include "MeshSimplifier.h"
+#include "Profiler.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+static constexpr float kNearPlane = 0.1f;
+static constexpr float kFarPlane = 100.0f;
+// A LOD switch needs the error this far past the threshold, in either direction
+static constexpr float kLodHysteresis = 0.25f;
+
+enum RenderPass : uint64_t
+{
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1
+};
+
+struct SortEntry
+{
+    uint64_t key;
+    uint32_t index;
+};
+
+// A run of sorted commands drawn with one call per mesh
+struct DrawBatch
+{
+    uint32_t firstEntry;
+    uint32_t count;
+    uint32_t firstInstance;
+    bool transparent;
+    // Has model matrices in the instance stream
+    bool instanced;
+    // Part of a multi-draw-indirect run; the run's first batch owns its draws
+    bool indirect;
+    uint32_t firstIndirectDraw;
+    uint32_t indirectDrawCount;
+};
+
+// One glMultiDrawElementsIndirect: meshes of consecutive opaque batches that
+// share a shader, textures and primitive type
+struct IndirectDraw
+{
+    Shader* shader;
+    Mesh* mesh;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+};
+
+struct IndirectEntry
+{
+    uint64_t stateKey;
+    uint32_t order;
+    Mesh* mesh;
+    DrawElementsIndirectCommand command;
+};
+
+// Commands recorded by one thread. Only its owner touches it between
+// BeginScene and EndScene, so Submit needs no synchronization.
+struct SubmitBucket
+{
+    std::vector<RenderCommand> commands;
+    // DrawParams blocks and their uniform overrides, rewound every BeginScene
+    LinearArena arena{64 * 1024};
+};
+
+static constexpr uint32_t kMaxSubmitThreads = 16;
 
 struct RendererData
 {
     glm::mat4 viewMatrix;
     glm::mat4 projectionMatrix;
     glm::vec3 cameraPosition;
+    Frustum frustum;
+    std::array<SubmitBucket, kMaxSubmitThreads> buckets;
+    // Bit i set while some thread owns buckets[i]
+    std::atomic<uint32_t> bucketsInUse{0};
+    // Shared by threads that arrive while every bucket is taken. Its arena is
+    // only touched under overflowMutex, including by the DrawParams setters.
+    SubmitBucket overflowBucket;
+    std::mutex overflowMutex;
+
+    // All buckets concatenated by EndScene. Capacity is kept across frames,
+    // clear() never gives it back.
     std::vector<RenderCommand> commandQueue;
 
+    // Kept across frames so sorting does not reallocate once warmed up
+    std::vector<SortEntry> sortEntries;
+    std::vector<SortEntry> sortScratch;
+
+    BoxSoA worldBounds;
+    std::vector<uint8_t> visibility;
+    RendererStats stats;
+
+    std::vector<DrawBatch> batches;
+    uint32_t instanceCount = 0;
+    RingAllocation instanceData;
+
+    // glMultiDrawElementsIndirect needs GL 4.3; main.cpp asks for a 3.3 context
+    bool indirectSupported = false;
+    bool indirectEnabled = true;
+    bool depthPrepass = false;
+
+    float lodPixelError = 1.0f;
+    float viewportHeight = 1080.0f;
+    // Pixels per unit of error at distance 1, from the projection and viewport
+    float lodScale = 0.0f;
+    std::vector<IndirectEntry> indirectScratch;
+    std::vector<DrawElementsIndirectCommand> indirectCommands;
+    std::vector<IndirectDraw> indirectDraws;
+    RingAllocation indirectData;
+    std::vector<IndexRange> visibleRanges;
+
+    unsigned int cameraUBO = 0;
+    // Per-frame GPU-visible memory for instance matrices and other streamed data
+    std::unique_ptr<GpuRingBuffer> streamBuffer;
+
     Skybox* activeSkybox = nullptr;
 };
 
 static RendererData s_Data;
 
+// A thread claims a free bucket the first time it submits and hands it back
+// when it exits, so short-lived workers do not use up the slots. Commands it
+// already recorded stay in the bucket until the next merge.
+struct BucketSlot
+{
+    int index = -1;
+
+    ~BucketSlot()
+    {
+        if (index >= 0 && index < static_cast<int>(kMaxSubmitThreads))
+            s_Data.bucketsInUse.fetch_and(~(1u << index), std::memory_order_release);
+    }
+};
+
+static thread_local BucketSlot t_BucketSlot;
+
+static SubmitBucket* AcquireBucket()
+{
+    int& index = t_BucketSlot.index;
+    if (index < 0)
+    {
+        index = static_cast<int>(kMaxSubmitThreads);
+        uint32_t inUse = s_Data.bucketsInUse.load(std::memory_order_relaxed);
+        while (inUse != (1u << kMaxSubmitThreads) - 1)
+        {
+            int free = 0;
+            while (inUse & (1u << free)) ++free;
+            if (s_Data.bucketsInUse.compare_exchange_weak(inUse, inUse | (1u << free), std::memory_order_acquire))
+            {
+                index = free;
+                break;
+            }
+        }
+    }
+    if (index < static_cast<int>(kMaxSubmitThreads))
+        return &s_Data.buckets[index];
+    // Every bucket is taken; look again on the next Submit
+    index = -1;
+    return nullptr;
+}
+
+static void ResetBuckets()
+{
+    for (SubmitBucket& bucket : s_Data.buckets)
+    {
+        bucket.commands.clear();
+        bucket.arena.Reset();
+    }
+    s_Data.overflowBucket.commands.clear();
+    s_Data.overflowBucket.arena.Reset();
+}
+
+static void MergeBuckets()
+{
+    auto& queue = s_Data.commandQueue;
+    queue.clear();
+    // Plain concatenation: the queue is radix-sorted by key afterwards anyway
+    for (const SubmitBucket& bucket : s_Data.buckets)
+        queue.insert(queue.end(), bucket.commands.begin(), bucket.commands.end());
+    queue.insert(queue.end(), s_Data.overflowBucket.commands.begin(), s_Data.overflowBucket.commands.end());
+}
+
+UniformOverride& DrawParams::Append(const char* name, UniformType type)
+{
+    // Hashed here, on the submitting thread, so Flush only probes the shader's table
+    std::unique_lock<std::mutex> lock;
+    if (arenaMutex) lock = std::unique_lock<std::mutex>(*arenaMutex);
+    UniformOverride* entry = arena->New<UniformOverride>();
+    // The handle keeps only a pointer, so the name is copied next to the entry
+    const size_t length = std::strlen(name) + 1;
+    char* copy = static_cast<char*>(arena->Allocate(length, 1));
+    std::memcpy(copy, name, length);
+    entry->handle = UniformHandle(copy);
+    entry->type = type;
+    entry->next = nullptr;
+
+    if (tail) tail->next = entry;
+    else head = entry;
+    tail = entry;
+    return *entry;
+}
+
+DrawParams& DrawParams::SetBool(const char* name, bool value)
+{
+    Append(name, UniformType::Bool).value[0] = value ? 1.0f : 0.0f;
+    return *this;
+}
+
+DrawParams& DrawParams::SetInt(const char* name, int value)
+{
+    std::memcpy(Append(name, UniformType::Int).value, &value, sizeof(int));
+    return *this;
+}
+
+DrawParams& DrawParams::SetFloat(const char* name, float value)
+{
+    Append(name, UniformType::Float).value[0] = value;
+    return *this;
+}
+
+DrawParams& DrawParams::SetVec3(const char* name, const glm::vec3& value)
+{
+    std::memcpy(Append(name, UniformType::Vec3).value, &value[0], sizeof(glm::vec3));
+    return *this;
+}
+
+DrawParams& DrawParams::SetVec4(const char* name, const glm::vec4& value)
+{
+    std::memcpy(Append(name, UniformType::Vec4).value, &value[0], sizeof(glm::vec4));
+    return *this;
+}
+
+DrawParams& DrawParams::SetMat4(const char* name, const glm::mat4& value)
+{
+    std::memcpy(Append(name, UniformType::Mat4).value, &value[0][0], sizeof(glm::mat4));
+    return *this;
+}
+
+void DrawParams::Apply(const Shader& shader) const
+{
+    for (const UniformOverride* u = head; u; u = u->next)
+    {
+        GLint location = shader.uniformLocation(u->handle);
+        switch (u->type)
+        {
+        case UniformType::Bool:  glUniform1i(location, u->value[0] != 0.0f); break;
+        case UniformType::Int:
+        {
+            int value;
+            std::memcpy(&value, u->value, sizeof(int));
+            glUniform1i(location, value);
+            break;
+        }
+        case UniformType::Float: glUniform1f(location, u->value[0]); break;
+        case UniformType::Vec3:  glUniform3fv(location, 1, u->value); break;
+        case UniformType::Vec4:  glUniform4fv(location, 1, u->value); break;
+        case UniformType::Mat4:  glUniformMatrix4fv(location, 1, GL_FALSE, u->value); break;
+        }
+    }
+}
+
+// Opaque:      [63:62] pass | [61:48] shader | [47:32] material | [31:16] VAO | [15:13] LOD | [12:0] depth
+// Transparent: [63:62] pass | [61:46] ~depth | [45:32] shader   | [31:16] material | [15:0] VAO
+// Opaque runs are grouped by state and drawn front-to-back inside a group
+// (LODs grow with distance, so grouping by LOD first keeps that roughly),
+// transparent ones are strictly back-to-front.
+static uint64_t BuildSortKey(const Model& model, float distToCamera, uint8_t lod)
+{
+    uint64_t shader = model.modelShader ? (model.modelShader->ID & 0x3FFF) : 0;
+    uint64_t material = 0;
+    uint64_t vao = 0;
+    if (!model.meshes.empty())
+    {
+        const Mesh& mesh = model.meshes[0];
+        if (!mesh.textures.empty()) material = mesh.textures[0].id & 0xFFFF;
+        vao = mesh.VAO & 0xFFFF;
+    }
+
+    float depth01 = std::clamp(distToCamera / kFarPlane, 0.0f, 1.0f);
+    uint64_t depth = static_cast<uint64_t>(depth01 * 65535.0f);
+
+    if (model.isTransparent)
+    {
+        return (uint64_t(PASS_TRANSPARENT) << 62) | ((0xFFFF - depth) << 46) | (shader << 32) | (material << 16) | vao;
+    }
+    return (uint64_t(PASS_OPAQUE) << 62) | (shader << 48) | (material << 32) | (vao << 16) | (uint64_t(lod & 0x7) << 13) | (depth >> 3);
+}
+
+// LSD radix sort on 8-bit digits. All histograms are built in one sweep and
+// digits on which every key agrees are skipped, which is the common case for
+// the high bytes since only a handful of shaders/materials are live.
+static void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+    const size_t count = entries.size();
+    if (count < 2) return;
+    scratch.resize(count);
+
+    uint32_t histograms[8][256] = {};
+    for (const SortEntry& e : entries)
+    {
+        for (int d = 0; d < 8; ++d)
+            histograms[d][(e.key >> (d * 8)) & 0xFF]++;
+    }
+
+    SortEntry* src = entries.data();
+    SortEntry* dst = scratch.data();
+    for (int d = 0; d < 8; ++d)
+    {
+        uint32_t* hist = histograms[d];
+        if (hist[(src[0].key >> (d * 8)) & 0xFF] == count) continue;
+
+        uint32_t offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            uint32_t n = hist[b];
+            hist[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; ++i)
+            dst[hist[(src[i].key >> (d * 8)) & 0xFF]++] = src[i];
+        std::swap(src, dst);
+    }
+
+    if (src != entries.data()) entries.swap(scratch);
+}
+
 void Renderer::Init()
 {
-    glEnable(GL_DEPTH_TEST);
+    GLState::Invalidate();
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
+    s_Data.streamBuffer = std::make_unique<GpuRingBuffer>(GL_ARRAY_BUFFER, 1024 * 1024);
+    s_Data.indirectSupported = GLAD_GL_VERSION_4_3 && glMultiDrawElementsIndirect != nullptr;
+
+    glGenBuffers(1, &s_Data.cameraUBO);
+    GLState::BindBuffer(GL_UNIFORM_BUFFER, s_Data.cameraUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), nullptr, GL_DYNAMIC_DRAW);
 }
 
 void Renderer::Shutdown()
 {
+    s_Data.streamBuffer.reset();
+    GLState::DeleteBuffer(s_Data.cameraUBO);
+    s_Data.cameraUBO = 0;
+    // Before the arenas: issued copies still write into them
+    GeometryUploadQueue::Shutdown();
+    GeometryArena::Shutdown();
+
     s_Data.commandQueue.clear();
+    ResetBuckets();
     s_Data.activeSkybox = nullptr;
 }
 
-void Renderer::BeginScene(const Camera& camera, float aspectRatio)
+void Renderer::BeginScene(const Camera& camera, float aspectRatio, float time)
 {
+    // Anything outside the renderer (ImGui, main.cpp) may have touched GL state
+    // since last frame. First, so the uploads below bind through a fresh cache
+    // and count in this frame's stats.
+    GLState::Invalidate();
+    GLState::ResetFrameStats();
+
+    // Swap in shaders that finished compiling; the rest keep drawing with what they have
+    Shader::UpdateAll();
+    // Same for geometry: copy this frame's share of staged uploads
+    GeometryUploadQueue::Process();
+
     s_Data.viewMatrix = const_cast<Camera&>(camera).GetViewMatrix();
-    s_Data.projectionMatrix = glm::perspective(glm::radians(camera.Zoom), aspectRatio, 0.1f, 100.0f);
+    s_Data.projectionMatrix = glm::perspective(glm::radians(camera.Zoom), aspectRatio, kNearPlane, kFarPlane);
     s_Data.cameraPosition = camera.Position;
+    s_Data.frustum = Frustum::FromMatrix(s_Data.projectionMatrix * s_Data.viewMatrix);
+    s_Data.lodScale = s_Data.projectionMatrix[1][1] * 0.5f * s_Data.viewportHeight;
+
+    CameraUniforms uniforms;
+    uniforms.view = s_Data.viewMatrix;
+    uniforms.projection = s_Data.projectionMatrix;
+    uniforms.viewProjection = s_Data.projectionMatrix * s_Data.viewMatrix;
+    uniforms.cameraPosition = glm::vec4(s_Data.cameraPosition, 1.0f);
+    uniforms.time = glm::vec4(time, 0.0f, 0.0f, 0.0f);
+    GLState::BindBuffer(GL_UNIFORM_BUFFER, s_Data.cameraUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &uniforms);
+    GLState::BindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UBO_BINDING, s_Data.cameraUBO);
+
+    s_Data.streamBuffer->BeginFrame();
 
     s_Data.commandQueue.clear();
+    ResetBuckets();
     s_Data.activeSkybox = nullptr;
 }
 
-void Renderer::Submit(Model& model, const glm::mat4& modelMatrix, std::function<void(Shader*)> callback)
+// Coarsest level whose error stays under the threshold on screen, measured
+// from the nearest point of the model's bounding sphere
+static uint8_t SelectLod(const Model& model, const glm::mat4& modelMatrix, LodState* state)
+{
+    const std::vector<float>& errors = model.lodErrors;
+    if (errors.size() < 2 || !model.bounds.Valid()) return 0;
+
+    const float scale = std::sqrt(std::max({glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+                                            glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1])),
+                                            glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]))}));
+    const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(model.bounds.Center(), 1.0f));
+    const float radius = glm::length(model.bounds.Extents()) * scale;
+    const float distance = std::max(glm::distance(s_Data.cameraPosition, center) - radius, kNearPlane);
+    const float pixelsPerUnit = scale * s_Data.lodScale / distance;
+
+    // The sort key has room for levels 0-7
+    const unsigned int level = MeshSimplifier::SelectLod(errors, 7, pixelsPerUnit, s_Data.lodPixelError,
+                                                         state ? state->level : -1, kLodHysteresis);
+    if (state) state->level = static_cast<uint8_t>(level);
+    return static_cast<uint8_t>(level);
+}
+
+DrawParams& Renderer::Submit(Model& model, const glm::mat4& modelMatrix, LodState* lodState)
 {
     float dist = glm::distance(s_Data.cameraPosition, glm::vec3(modelMatrix[3]));
-    s_Data.commandQueue.push_back({&model, modelMatrix, callback, dist});
+    uint8_t lod = SelectLod(model, modelMatrix, lodState);
+    uint64_t key = BuildSortKey(model, dist, lod);
+
+    SubmitBucket* bucket = AcquireBucket();
+    if (bucket)
+    {
+        DrawParams* params = bucket->arena.New<DrawParams>(&bucket->arena);
+        bucket->commands.push_back({&model, modelMatrix, params, dist, lod, key});
+        return *params;
+    }
+
+    std::lock_guard<std::mutex> lock(s_Data.overflowMutex);
+    SubmitBucket& overflow = s_Data.overflowBucket;
+    DrawParams* params = overflow.arena.New<DrawParams>(&overflow.arena, &s_Data.overflowMutex);
+    overflow.commands.push_back({&model, modelMatrix, params, dist, lod, key});
+    return *params;
 }
 
 
@@ -52,22 +453,440 @@ void Renderer::SetSkybox(Skybox& skybox)
 
 void Renderer::EndScene()
 {
+    MergeBuckets();
+    {
+        PROFILE_CPU_SCOPE("Renderer::Cull");
+        Cull();
+    }
     Flush();
 }
 
+const RendererStats& Renderer::GetStats()
+{
+    return s_Data.stats;
+}
+
+void Renderer::SetIndirectDrawing(bool enabled)
+{
+    s_Data.indirectEnabled = enabled;
+}
+
+bool Renderer::IsIndirectDrawingSupported()
+{
+    return s_Data.indirectSupported;
+}
+
+void Renderer::SetDepthPrepass(bool enabled)
+{
+    s_Data.depthPrepass = enabled;
+}
+
+bool Renderer::IsDepthPrepassEnabled()
+{
+    return s_Data.depthPrepass;
+}
+
+void Renderer::SetLodThreshold(float pixelError, float viewportHeight)
+{
+    s_Data.lodPixelError = pixelError;
+    s_Data.viewportHeight = viewportHeight;
+}
+
+void Renderer::Cull()
+{
+    auto& boxes = s_Data.worldBounds;
+    boxes.Clear();
+    for (const RenderCommand& cmd : s_Data.commandQueue)
+        boxes.Push(cmd.model ? cmd.model->bounds : AABB(), cmd.modelMatrix);
+
+    s_Data.visibility.resize(boxes.Size());
+    size_t visible = CullBoxes(s_Data.frustum, boxes, s_Data.visibility.data());
+
+    s_Data.stats.submitted = static_cast<uint32_t>(s_Data.commandQueue.size());
+    s_Data.stats.visible = static_cast<uint32_t>(visible);
+    s_Data.stats.culled = s_Data.stats.submitted - s_Data.stats.visible;
+}
+
+// Consecutive sorted commands for the same model and LOD with no uniform
+// overrides can share one instanced draw, since they only differ by model matrix.
+static bool CanInstanceTogether(const RenderCommand& a, const RenderCommand& b)
+{
+    return a.model == b.model && a.lod == b.lod && a.params->Empty() && b.params->Empty();
+}
+
+static bool IndirectActive()
+{
+    return s_Data.indirectSupported && s_Data.indirectEnabled;
+}
+
+static const RenderCommand& FirstCommand(const DrawBatch& batch)
+{
+    return s_Data.commandQueue[s_Data.sortEntries[batch.firstEntry].index];
+}
+
+// Multi-draw can only vary the matrix per draw, so blended draws (which
+// need strict ordering) and anything with uniform overrides stay separate
+static bool CanDrawIndirect(const DrawBatch& batch)
+{
+    return !batch.transparent && FirstCommand(batch).params->Empty();
+}
+
+static void BuildBatches()
+{
+    const auto& entries = s_Data.sortEntries;
+    auto& batches = s_Data.batches;
+    batches.clear();
+    s_Data.instanceCount = 0;
+
+    for (uint32_t i = 0; i < entries.size();)
+    {
+        const RenderCommand& first = s_Data.commandQueue[entries[i].index];
+        uint32_t end = i + 1;
+        while (end < entries.size() && CanInstanceTogether(first, s_Data.commandQueue[entries[end].index]))
+            ++end;
+
+        DrawBatch batch{i, end - i, 0, (entries[i].key >> 62) == PASS_TRANSPARENT, false, false, 0, 0};
+        if (batch.count > 1 || (IndirectActive() && CanDrawIndirect(batch)))
+        {
+            batch.instanced = true;
+            batch.firstInstance = s_Data.instanceCount;
+            s_Data.instanceCount += batch.count;
+        }
+        batches.push_back(batch);
+        i = end;
+    }
+}
+
+static bool SameMaterial(const Mesh& a, const Mesh& b)
+{
+    if (a.VAO != b.VAO || a.drawMode != b.drawMode || a.doubleSided != b.doubleSided || a.textures.size() != b.textures.size()) return false;
+    for (size_t i = 0; i < a.textures.size(); ++i)
+        if (a.textures[i].id != b.textures[i].id) return false;
+    return true;
+}
+
+// Groups runs of indirect-capable batches with the same shader, then splits
+// each run's meshes by material into one command list per multi-draw
+static void BuildIndirectDraws()
+{
+    s_Data.indirectCommands.clear();
+    s_Data.indirectDraws.clear();
+    if (!IndirectActive()) return;
+
+    auto& batches = s_Data.batches;
+    auto& scratch = s_Data.indirectScratch;
+    for (size_t i = 0; i < batches.size();)
+    {
+        if (!CanDrawIndirect(batches[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        const Model& firstModel = *FirstCommand(batches[i]).model;
+        Shader* shader = firstModel.instancedShader;
+        // The depth pre-pass replays whole runs, so runs do not mix models in and out of it
+        size_t end = i + 1;
+        while (end < batches.size() && CanDrawIndirect(batches[end]) && FirstCommand(batches[end]).model->instancedShader == shader &&
+               FirstCommand(batches[end]).model->depthPrepass == firstModel.depthPrepass)
+            ++end;
+
+        scratch.clear();
+        for (size_t b = i; b < end; ++b)
+        {
+            DrawBatch& batch = batches[b];
+            batch.indirect = true;
+            const uint8_t lod = FirstCommand(batch).lod;
+            for (Mesh& mesh : FirstCommand(batch).model->meshes)
+            {
+                if (!mesh.IsResident() || mesh.geometry->indexCount == 0) continue;
+                uint64_t texture = mesh.textures.empty() ? 0 : mesh.textures[0].id;
+                // Arena (VAO) first: each one is a separate bind
+                uint64_t stateKey = (uint64_t(mesh.VAO & 0xFFFF) << 48) | ((texture & 0xFFFFFFFF) << 16) |
+                                    (uint64_t(mesh.doubleSided) << 15) | (mesh.drawMode & 0x7FFF);
+                if (!mesh.UsesMeshlets(lod))
+                {
+                    scratch.push_back({stateKey, static_cast<uint32_t>(scratch.size()), &mesh,
+                                       mesh.IndirectCommand(batch.count, batch.firstInstance, lod)});
+                    continue;
+                }
+
+                // One command per surviving run of meshlets per instance; baseInstance picks the matrix
+                for (uint32_t j = 0; j < batch.count; ++j)
+                {
+                    const RenderCommand& instance = s_Data.commandQueue[s_Data.sortEntries[batch.firstEntry + j].index];
+                    MeshletCullView view = MeshletCullView::Make(s_Data.frustum, instance.modelMatrix, s_Data.cameraPosition);
+                    s_Data.visibleRanges.clear();
+                    CullMeshlets(mesh.meshlets, view, !mesh.doubleSided, s_Data.visibleRanges);
+                    s_Data.stats.meshletsTested += view.tested;
+                    s_Data.stats.meshletsCulled += view.culled;
+                    for (const IndexRange& range : s_Data.visibleRanges)
+                    {
+                        DrawElementsIndirectCommand command{range.indexCount, 1, mesh.geometry->firstIndex + range.firstIndex,
+                                                            mesh.geometry->baseVertex, batch.firstInstance + j};
+                        scratch.push_back({stateKey, static_cast<uint32_t>(scratch.size()), &mesh, command});
+                    }
+                }
+            }
+        }
+        // std::sort rather than stable_sort, which may allocate; order breaks ties
+        std::sort(scratch.begin(), scratch.end(), [](const IndirectEntry& a, const IndirectEntry& b) {
+            return a.stateKey != b.stateKey ? a.stateKey < b.stateKey : a.order < b.order;
+        });
+
+        batches[i].firstIndirectDraw = static_cast<uint32_t>(s_Data.indirectDraws.size());
+        for (size_t e = 0; e < scratch.size(); ++e)
+        {
+            if (e == 0 || !SameMaterial(*scratch[e - 1].mesh, *scratch[e].mesh))
+                s_Data.indirectDraws.push_back({shader, scratch[e].mesh, static_cast<uint32_t>(s_Data.indirectCommands.size()), 0});
+            s_Data.indirectCommands.push_back(scratch[e].command);
+            s_Data.indirectDraws.back().commandCount++;
+        }
+        batches[i].indirectDrawCount = static_cast<uint32_t>(s_Data.indirectDraws.size()) - batches[i].firstIndirectDraw;
+        i = end;
+    }
+}
+
+static void WriteIndirectCommands()
+{
+    s_Data.indirectData = RingAllocation();
+    const auto& commands = s_Data.indirectCommands;
+    if (commands.empty()) return;
+
+    GpuRingBuffer& ring = *s_Data.streamBuffer;
+    s_Data.indirectData = ring.Allocate(commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+    if (!s_Data.indirectData) return;
+    std::memcpy(s_Data.indirectData.ptr, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+    ring.Commit();
+}
+
+static void DrawIndirect(const DrawBatch& batch)
+{
+    GLuint buffer = s_Data.streamBuffer->Buffer();
+    GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+
+    GLuint boundVAO = 0;
+    for (uint32_t d = 0; d < batch.indirectDrawCount; ++d)
+    {
+        const IndirectDraw& draw = s_Data.indirectDraws[batch.firstIndirectDraw + d];
+        // Draws are grouped by arena, so this rebinds once per vertex format
+        if (draw.mesh->VAO != boundVAO)
+        {
+            draw.mesh->Arena().BindInstanceStream(buffer, s_Data.instanceData.offset);
+            boundVAO = draw.mesh->VAO;
+        }
+        draw.shader->use();
+        draw.mesh->BindTextures(*draw.shader);
+        draw.mesh->ApplyFaceCulling();
+
+        GLintptr offset = s_Data.indirectData.offset + GLintptr(draw.firstCommand) * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(draw.mesh->drawMode, draw.mesh->geometry->indexType, (const void*)offset, draw.commandCount, 0);
+        s_Data.stats.drawCalls++;
+    }
+}
+
+// Same commands as DrawIndirect, but one multi-draw per arena: without
+// textures, neighbouring material groups collapse into one command range
+static void DrawIndirectDepth(const DrawBatch& batch)
+{
+    GLuint buffer = s_Data.streamBuffer->Buffer();
+    GLState::BindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+    Shader::DepthOnly(true).use();
+
+    for (uint32_t d = 0; d < batch.indirectDrawCount;)
+    {
+        const IndirectDraw& first = s_Data.indirectDraws[batch.firstIndirectDraw + d];
+        uint32_t commandCount = first.commandCount;
+        uint32_t end = d + 1;
+        for (; end < batch.indirectDrawCount; ++end)
+        {
+            const IndirectDraw& next = s_Data.indirectDraws[batch.firstIndirectDraw + end];
+            if (next.mesh->VAO != first.mesh->VAO || next.mesh->drawMode != first.mesh->drawMode ||
+                next.mesh->doubleSided != first.mesh->doubleSided) break;
+            commandCount += next.commandCount;
+        }
+
+        first.mesh->ApplyFaceCulling();
+        first.mesh->Arena().BindInstanceStream(buffer, s_Data.instanceData.offset, true);
+        GLintptr offset = s_Data.indirectData.offset + GLintptr(first.firstCommand) * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(first.mesh->drawMode, first.mesh->geometry->indexType, (const void*)offset, commandCount, 0);
+        s_Data.stats.depthPrepassDrawCalls++;
+        d = end;
+    }
+}
+
+static bool UsesDepthPrepass(const DrawBatch& batch)
+{
+    return s_Data.depthPrepass && !batch.transparent && FirstCommand(batch).model->depthPrepass;
+}
+
+// Depth only, no color writes. Uniform overrides are ignored: they cannot
+// move vertices, since the shading pass must produce the same depth.
+static void DrawDepthPrepass(bool indirectReady)
+{
+    PROFILE_SCOPE("Renderer::DepthPrepass");
+    GLState::ColorMask(GL_FALSE);
+    GLState::DepthMask(GL_TRUE);
+    GLState::DepthFunc(GL_LESS);
+
+    for (const DrawBatch& batch : s_Data.batches)
+    {
+        if (!UsesDepthPrepass(batch)) continue;
+        Model& model = *FirstCommand(batch).model;
+
+        if (batch.indirect && indirectReady)
+        {
+            if (batch.indirectDrawCount > 0) DrawIndirectDepth(batch);
+            continue;
+        }
+
+        if (batch.count > 1 && s_Data.instanceData)
+        {
+            GLintptr offset = s_Data.instanceData.offset + static_cast<GLintptr>(batch.firstInstance) * sizeof(glm::mat4);
+            model.DrawDepthInstanced(Shader::DepthOnly(true), s_Data.streamBuffer->Buffer(), offset, batch.count, FirstCommand(batch).lod);
+            s_Data.stats.depthPrepassDrawCalls += static_cast<uint32_t>(model.meshes.size());
+            continue;
+        }
+
+        for (uint32_t j = 0; j < batch.count; ++j)
+        {
+            const RenderCommand& single = s_Data.commandQueue[s_Data.sortEntries[batch.firstEntry + j].index];
+            MeshletCullView view = MeshletCullView::Make(s_Data.frustum, single.modelMatrix, s_Data.cameraPosition);
+            single.model->DrawDepth(Shader::DepthOnly(false), single.modelMatrix, single.lod, &view);
+            s_Data.stats.depthPrepassDrawCalls += static_cast<uint32_t>(single.model->meshes.size());
+        }
+    }
+
+    GLState::ColorMask(GL_TRUE);
+}
+
+// Writes the matrices of every instanced batch straight into the stream buffer
+static void WriteInstanceMatrices()
+{
+    s_Data.instanceData = RingAllocation();
+    if (s_Data.instanceCount == 0) return;
+
+    GpuRingBuffer& ring = *s_Data.streamBuffer;
+    GLsizeiptr bytes = static_cast<GLsizeiptr>(s_Data.instanceCount) * sizeof(glm::mat4);
+    // Indirect commands share the frame; meshlet culling can emit many per instance
+    GLsizeiptr frameBytes = bytes + static_cast<GLsizeiptr>(s_Data.indirectCommands.size()) * sizeof(DrawElementsIndirectCommand) + 256;
+    if (frameBytes > ring.FrameSize())
+        ring.Reserve(std::max(frameBytes, ring.FrameSize() * 2));
+
+    s_Data.instanceData = ring.Allocate(bytes, sizeof(glm::mat4));
+    if (!s_Data.instanceData) return;
+
+    glm::mat4* dst = static_cast<glm::mat4*>(s_Data.instanceData.ptr);
+    for (const DrawBatch& batch : s_Data.batches)
+    {
+        if (!batch.instanced) continue;
+        for (uint32_t j = 0; j < batch.count; ++j)
+            dst[batch.firstInstance + j] = s_Data.commandQueue[s_Data.sortEntries[batch.firstEntry + j].index].modelMatrix;
+    }
+    ring.Commit();
+}
+
 void Renderer::Flush()
 {
-    for (const auto& cmd : s_Data.commandQueue)
+    PROFILE_SCOPE("Renderer::Flush");
+    auto& entries = s_Data.sortEntries;
+    entries.clear();
+    for (uint32_t i = 0; i < s_Data.commandQueue.size(); ++i)
     {
-        if (!cmd.model || !cmd.model->modelShader) continue;
-        Shader* shader = cmd.model->modelShader;
-        shader->use();
-        if (cmd.uniformCallback) cmd.uniformCallback(shader);
-        cmd.model->Draw(cmd.modelMatrix, s_Data.viewMatrix, s_Data.projectionMatrix);
+        const RenderCommand& cmd = s_Data.commandQueue[i];
+        if (s_Data.visibility[i] && cmd.model && cmd.model->modelShader)
+            entries.push_back({cmd.sortKey, i});
     }
+    RadixSort(entries, s_Data.sortScratch);
 
-    if (s_Data.activeSkybox)
+    s_Data.stats.meshletsTested = 0;
+    s_Data.stats.meshletsCulled = 0;
+    BuildBatches();
+    BuildIndirectDraws();
+    WriteInstanceMatrices();
+    WriteIndirectCommands();
+    const bool indirectReady = s_Data.instanceData && s_Data.indirectData;
+
+    s_Data.stats.drawCalls = 0;
+    s_Data.stats.depthPrepassDrawCalls = 0;
+    if (s_Data.depthPrepass) DrawDepthPrepass(indirectReady);
+    GLState::DepthFunc(GL_LESS);
+
+    bool skyboxDrawn = false;
+    bool blending = false;
+    for (const DrawBatch& batch : s_Data.batches)
     {
-        s_Data.activeSkybox->Draw(s_Data.viewMatrix, s_Data.projectionMatrix);
+        const RenderCommand& cmd = s_Data.commandQueue[entries[batch.firstEntry].index];
+
+        // The skybox goes after all opaque geometry and before anything blended over it
+        if (batch.transparent && !blending)
+        {
+            if (s_Data.activeSkybox)
+            {
+                s_Data.activeSkybox->Draw();
+                s_Data.stats.drawCalls++;
+                GLState::DepthFunc(GL_LESS);
+            }
+            skyboxDrawn = true;
+
+            GLState::SetEnabled(GL_BLEND, true);
+            GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            GLState::DepthMask(GL_FALSE);
+            blending = true;
+        }
+        else if (!batch.transparent)
+        {
+            // Depth is already final for pre-passed geometry: shade only the visible surface
+            const bool prepassed = UsesDepthPrepass(batch);
+            GLState::DepthFunc(prepassed ? GL_EQUAL : GL_LESS);
+            GLState::DepthMask(prepassed ? GL_FALSE : GL_TRUE);
+        }
+
+        if (batch.indirect && indirectReady)
+        {
+            // Later batches of the run were folded into the first one's draws
+            if (batch.indirectDrawCount > 0) DrawIndirect(batch);
+            continue;
+        }
+
+        if (batch.count > 1 && s_Data.instanceData)
+        {
+            GLintptr offset = s_Data.instanceData.offset + static_cast<GLintptr>(batch.firstInstance) * sizeof(glm::mat4);
+            cmd.model->DrawInstanced(s_Data.streamBuffer->Buffer(), offset, batch.count, cmd.lod);
+            s_Data.stats.drawCalls += static_cast<uint32_t>(cmd.model->meshes.size());
+            continue;
+        }
+
+        // Single draws, or every draw of the batch if the stream buffer could not be mapped
+        for (uint32_t j = 0; j < batch.count; ++j)
+        {
+            const RenderCommand& single = s_Data.commandQueue[entries[batch.firstEntry + j].index];
+            Shader* shader = single.model->modelShader;
+            shader->use();
+            single.params->Apply(*shader);
+            // Culls exactly like the depth pre-pass did, so GL_EQUAL still matches
+            MeshletCullView view = MeshletCullView::Make(s_Data.frustum, single.modelMatrix, s_Data.cameraPosition);
+            single.model->Draw(single.modelMatrix, single.lod, &view);
+            s_Data.stats.meshletsTested += view.tested;
+            s_Data.stats.meshletsCulled += view.culled;
+            s_Data.stats.drawCalls += static_cast<uint32_t>(single.model->meshes.size());
+        }
     }
+
+    if (blending)
+        GLState::SetEnabled(GL_BLEND, false);
+    // Also after an opaque GL_EQUAL pass; glClear skips depth while the mask is off
+    GLState::DepthMask(GL_TRUE);
+    GLState::SetEnabled(GL_CULL_FACE, false);
+
+    if (!skyboxDrawn && s_Data.activeSkybox)
+    {
+        s_Data.activeSkybox->Draw();
+        s_Data.stats.drawCalls++;
+    }
+
+    s_Data.streamBuffer->EndFrame();
+
+    s_Data.stats.stateChanges = GLState::GetStats().issued;
+    s_Data.stats.stateChangesSkipped = GLState::GetStats().skipped;
 }
@@ -2,19 +2,90 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include <functional>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
+#include "RenderTypes.h"
+
 class Model;
 class Shader;
 class Camera;
 class Skybox;
+class LinearArena;
+
+enum class UniformType : uint8_t {
+    Bool,
+    Int,
+    Float,
+    Vec3,
+    Vec4,
+    Mat4
+};
+
+struct UniformOverride {
+    UniformHandle handle;
+    UniformType type;
+    float value[16];
+    UniformOverride* next;
+};
+
+// Per-draw uniform overrides. Lives in the submitting thread's frame arena
+// together with its entries and names, so it is only valid until the next
+// BeginScene and must be filled by the thread that submitted it. An arena
+// shared between threads comes with the mutex that guards it.
+class DrawParams {
+public:
+    explicit DrawParams(LinearArena* arena, std::mutex* arenaMutex = nullptr) : arena(arena), arenaMutex(arenaMutex) {}
+
+    DrawParams& SetBool(const char* name, bool value);
+    DrawParams& SetInt(const char* name, int value);
+    DrawParams& SetFloat(const char* name, float value);
+    DrawParams& SetVec3(const char* name, const glm::vec3& value);
+    DrawParams& SetVec4(const char* name, const glm::vec4& value);
+    DrawParams& SetMat4(const char* name, const glm::mat4& value);
+
+    bool Empty() const { return head == nullptr; }
+    void Apply(const Shader& shader) const;
+
+private:
+    LinearArena* arena;
+    std::mutex* arenaMutex;
+    UniformOverride* head = nullptr;
+    UniformOverride* tail = nullptr;
+
+    UniformOverride& Append(const char* name, UniformType type);
+};
+
+// LOD chosen for one object last frame. Kept by the caller and passed to
+// Submit so the level only changes once the error is clearly past the threshold.
+struct LodState {
+    uint8_t level = 0;
+};
 
 struct RenderCommand {
     Model* model;
     glm::mat4 modelMatrix;
-    std::function<void(Shader*)> uniformCallback;
+    const DrawParams* params;
     float distToCamera;
+    uint8_t lod;
+    // pass | shader | material | VAO | depth, see BuildSortKey in Renderer.cpp
+    uint64_t sortKey;
+};
+
+struct RendererStats {
+    uint32_t submitted = 0;
+    uint32_t visible = 0;
+    uint32_t culled = 0;
+    uint32_t drawCalls = 0;
+    // Position-only draws of the depth pre-pass, not included in drawCalls
+    uint32_t depthPrepassDrawCalls = 0;
+    // Meshlets of LOD 0 meshes tested / rejected by the cone and frustum tests
+    uint32_t meshletsTested = 0;
+    uint32_t meshletsCulled = 0;
+    // GL state changes that reached the driver / were dropped as redundant
+    uint32_t stateChanges = 0;
+    uint32_t stateChangesSkipped = 0;
 };
 
 class Renderer {
@@ -22,14 +93,38 @@ public:
     static void Init();
     static void Shutdown();
 
-    static void BeginScene(const Camera& camera, float aspectRatio);
+    // Uploads the CameraData uniform block once for the whole frame
+    static void BeginScene(const Camera& camera, float aspectRatio, float time = 0.0f);
 
-    static void Submit(Model& model, const glm::mat4& modelMatrix, std::function<void(Shader*)> callback = nullptr);
+    // Safe to call from any thread between BeginScene and EndScene; each thread
+    // records into its own bucket. All submitting threads must be done before
+    // EndScene, which merges the buckets on the render thread.
+    // The returned block can be used to override uniforms for this draw only.
+    // Pass a LodState that lives with the object to get LOD hysteresis.
+    static DrawParams& Submit(Model& model, const glm::mat4& modelMatrix, LodState* lodState = nullptr);
 
     static void SetSkybox(Skybox& skybox);
 
     static void EndScene();
 
+    // Counters for the last finished scene
+    static const RendererStats& GetStats();
+
+    // Opaque draws sharing a shader go out as one glMultiDrawElementsIndirect
+    // per material when the context supports it (GL 4.3); on by default
+    static void SetIndirectDrawing(bool enabled);
+    static bool IsIndirectDrawingSupported();
+
+    // Lays down opaque depth with a position-only pass first, then shades
+    // opaque geometry with GL_EQUAL so each pixel is shaded once; off by default
+    static void SetDepthPrepass(bool enabled);
+    static bool IsDepthPrepassEnabled();
+
+    // Models draw the coarsest LOD whose error projects to at most
+    // pixelError pixels on a viewport viewportHeight pixels tall
+    static void SetLodThreshold(float pixelError, float viewportHeight);
+
 private:
+    static void Cull();
     static void Flush();
 };
\ No newline at end of file
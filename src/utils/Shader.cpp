@@ -1,93 +1,547 @@
 #include "Shader.h"
+#include "GLState.h"
+#include "RenderTypes.h"
+#include "ProgramBinaryCache.h"
+#include "FileWatcher.h"
+#include "ShaderPreprocessor.h"
+#include "ShaderVariants.h"
+#include "Profiler.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile; not in the glad headers
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Without the extension a status query blocks until the compile is done, so
+// give the driver's own compiler thread this many frames before asking
+static constexpr unsigned kFramesBeforeBlockingPoll = 2;
+
+// Drawn with while a shader's first compile is in flight. Same interface as
+// the scene shaders (camera block, model or instance attributes), flat magenta.
+// One per define set, so the instancing switch matches the real variant.
+static const char* kFallbackVertexSource = R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+invariant gl_Position;
+
+layout (std140) uniform CameraData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 time;
+};
+
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+#else
+uniform mat4 model;
+#endif
+
+void main()
 {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+#ifdef INSTANCED
+    mat4 world = aInstanceModel;
+#else
+    mat4 world = model;
+#endif
+    gl_Position = viewProjection * world * vec4(aPos, 1.0);
+}
+)";
+
+// Depth writes only; paired with the fallback vertex stage, which transforms like mesh.vs
+static const char* kDepthOnlyFragmentSource = R"(#version 330 core
+
+void main()
+{
+}
+)";
 
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
+static const char* kFallbackFragmentSource = R"(#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(1.0, 0.0, 1.0, 1.0);
+}
+)";
+
+static bool s_AsyncCompilation = false;
+static std::vector<Shader*> s_Shaders;
+static std::unordered_map<std::string, std::unique_ptr<Shader>> s_Fallbacks;
+static std::unique_ptr<Shader> s_DepthOnly[2];
+static std::unique_ptr<FileWatcher> s_Watcher;
+
+static bool SupportsParallelCompile()
+{
+    static int supported = -1;
+    if (supported < 0)
     {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
+        supported = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (name && (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+                         std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+            {
+                supported = 1;
+                break;
+            }
+        }
+    }
+    return supported == 1;
+}
 
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+Shader::Shader()
+    : ID(0)
+{
+}
 
-        vShaderFile.close();
-        fShaderFile.close();
+// As read from disk, so an unreadable include still gets watched and reported by the compile
+static ShaderSources ReadOrPartial(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+{
+    ShaderSources sources;
+    Shader::ReadSources(vertexPath, fragmentPath, defines, sources);
+    return sources;
+}
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+static std::vector<std::string> CanonicalFiles(const std::vector<std::string>& files)
+{
+    std::vector<std::string> canonical;
+    for (const std::string& file : files)
+        canonical.push_back(FileWatcher::Canonical(file));
+    return canonical;
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+    : Shader(vertexPath, fragmentPath, defines, ReadOrPartial(vertexPath, fragmentPath, defines))
+{
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines, ShaderSources sources)
+    : ID(0), defines(defines), sources(std::move(sources))
+{
+    s_Shaders.push_back(this);
+    sourcePaths.push_back(SourcePaths{vertexPath, fragmentPath, CanonicalFiles(this->sources.files)});
+    watch(sourcePaths[0]);
+
+    const uint64_t cacheKey = ProgramBinaryCache::Key(this->sources.vertexCode, this->sources.fragmentCode, defines);
+    GLuint cached = glCreateProgram();
+    if (ProgramBinaryCache::Load(cached, cacheKey))
+    {
+        adoptProgram(cached);
+        return;
     }
-    catch (std::ifstream::failure& e)
+    glDeleteProgram(cached);
+
+    beginCompile(this->sources.vertexCode, this->sources.fragmentCode, cacheKey);
+    if (s_AsyncCompilation)
+        useFallback();
+    else
+        finishCompile();
+}
+
+Shader::~Shader()
+{
+    s_Shaders.erase(std::remove(s_Shaders.begin(), s_Shaders.end(), this), s_Shaders.end());
+    discardPending();
+    if (ownsProgram) GLState::DeleteProgram(ID);
+}
+
+bool Shader::ReadSources(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines,
+                         ShaderSources& sources)
+{
+    // Separate lists: include-once applies per stage, and #line indices are per stage
+    std::vector<std::string> fragmentFiles;
+    bool ok = ShaderPreprocessor::Process(vertexPath, defines, sources.vertexCode, sources.files);
+    ok = ShaderPreprocessor::Process(fragmentPath, defines, sources.fragmentCode, fragmentFiles) && ok;
+    sources.files.insert(sources.files.end(), fragmentFiles.begin(), fragmentFiles.end());
+    return ok;
+}
+
+bool Shader::readSources(size_t pair)
+{
+    ShaderSources read;
+    const bool ok = ReadSources(sourcePaths[pair].vertex, sourcePaths[pair].fragment, defines, read);
+    // Keep the old list if a file vanished mid-save, so the next save still triggers a reload
+    if (ok)
     {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+        sourcePaths[pair].files = CanonicalFiles(read.files);
+        sources = std::move(read);
+        revision++;
     }
+    watch(sourcePaths[pair]);
+    return ok;
+}
+
+void Shader::watch(const SourcePaths& paths) const
+{
+    if (!s_Watcher) return;
+    for (const std::string& file : paths.files)
+        s_Watcher->Watch(file);
+}
+
+void Shader::addSourcePaths(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& files)
+{
+    SourcePaths paths{vertexPath, fragmentPath, CanonicalFiles(files)};
+    for (const SourcePaths& existing : sourcePaths)
+        if (existing.files == paths.files) return;
+    sourcePaths.push_back(std::move(paths));
+    watch(sourcePaths.back());
+}
+
+void Shader::beginCompile(const std::string& vertexCode, const std::string& fragmentCode, uint64_t cacheKey)
+{
+    PROFILE_CPU_SCOPE("Shader::beginCompile");
+    discardPending();
+
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
-    unsigned int vertex, fragment;
-
+    // No status queries here: they would wait for the driver to finish
     // Vertex Shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    pending.vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pending.vertex, 1, &vShaderCode, NULL);
+    glCompileShader(pending.vertex);
 
     // Fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    pending.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pending.fragment, 1, &fShaderCode, NULL);
+    glCompileShader(pending.fragment);
 
     // Shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+    pending.program = glCreateProgram();
+    glAttachShader(pending.program, pending.vertex);
+    glAttachShader(pending.program, pending.fragment);
+    if (ProgramBinaryCache::IsSupported())
+        glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending.program);
 
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    pending.cacheKey = cacheKey;
+    pending.framesWaited = 0;
+}
+
+bool Shader::pollCompile()
+{
+    if (!pending.program) return false;
+
+    if (SupportsParallelCompile())
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) return false;
+    }
+    else if (++pending.framesWaited < kFramesBeforeBlockingPoll)
+    {
+        return false;
+    }
+
+    finishCompile();
+    return true;
+}
+
+void Shader::finishCompile()
+{
+    PROFILE_CPU_SCOPE("Shader::finishCompile");
+    bool ok = checkCompileErrors(pending.vertex, "VERTEX");
+    ok = checkCompileErrors(pending.fragment, "FRAGMENT") && ok;
+    ok = ok && checkCompileErrors(pending.program, "PROGRAM");
+
+    GLuint program = pending.program;
+    glDetachShader(program, pending.vertex);
+    glDetachShader(program, pending.fragment);
+    glDeleteShader(pending.vertex);
+    glDeleteShader(pending.fragment);
+    const uint64_t cacheKey = pending.cacheKey;
+    pending = PendingProgram();
+
+    // A broken edit keeps drawing with whatever was there before
+    if (!ok)
+    {
+        glDeleteProgram(program);
+        if (!ID) useFallback();
+        return;
+    }
+
+    ProgramBinaryCache::Store(program, cacheKey);
+    adoptProgram(program);
+}
+
+void Shader::discardPending()
+{
+    if (!pending.program) return;
+    glDeleteShader(pending.vertex);
+    glDeleteShader(pending.fragment);
+    glDeleteProgram(pending.program);
+    pending = PendingProgram();
+}
+
+void Shader::adoptProgram(GLuint program)
+{
+    if (ownsProgram) GLState::DeleteProgram(ID);
+    ID = program;
+    ownsProgram = true;
+
+    // GLSL 330 has no layout(binding), so hook the shared camera block up here.
+    // Block bindings are not part of the program binary, so this runs on every path.
+    unsigned int cameraBlock = glGetUniformBlockIndex(ID, "CameraData");
+    if (cameraBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, cameraBlock, CAMERA_UBO_BINDING);
+
+    cacheUniformLocations();
+}
+
+void Shader::useFallback()
+{
+    std::unique_ptr<Shader>& fallback = s_Fallbacks[defines];
+    if (!fallback)
+    {
+        fallback.reset(new Shader());
+        fallback->beginCompile(ShaderPreprocessor::InjectDefines(kFallbackVertexSource, defines),
+                               ShaderPreprocessor::InjectDefines(kFallbackFragmentSource, defines), 0);
+        fallback->finishCompile();
+    }
+    ID = fallback->ID;
+    uniformTable = fallback->uniformTable;
+    uniformCount = fallback->uniformCount;
+    ownsProgram = false;
+}
+
+Shader& Shader::DepthOnly(bool instanced)
+{
+    std::unique_ptr<Shader>& shader = s_DepthOnly[instanced ? 1 : 0];
+    if (!shader)
+    {
+        const std::string defines = ShaderFeatureDefines(instanced ? SHADER_FEATURE_INSTANCED : 0);
+        shader.reset(new Shader());
+        shader->defines = defines;
+        shader->beginCompile(ShaderPreprocessor::InjectDefines(kFallbackVertexSource, defines),
+                             ShaderPreprocessor::InjectDefines(kDepthOnlyFragmentSource, defines), 0);
+        shader->finishCompile();
+    }
+    return *shader;
+}
+
+bool Shader::isReady() const
+{
+    return ownsProgram;
+}
+
+void Shader::reload(const std::string& changedFile)
+{
+    size_t pair = 0;
+    while (pair < sourcePaths.size() &&
+           std::find(sourcePaths[pair].files.begin(), sourcePaths[pair].files.end(), changedFile) == sourcePaths[pair].files.end())
+        pair++;
+    if (pair == sourcePaths.size() || !readSources(pair)) return;
+    beginCompile(sources.vertexCode, sources.fragmentCode, ProgramBinaryCache::Key(sources.vertexCode, sources.fragmentCode, defines));
+    std::cout << "Recompiling shader: " << sourcePaths[pair].vertex << ", " << sourcePaths[pair].fragment << std::endl;
+}
+
+void Shader::SetAsyncCompilation(bool enabled)
+{
+    s_AsyncCompilation = enabled;
+}
+
+void Shader::SetHotReload(bool enabled)
+{
+    if (!enabled)
+    {
+        s_Watcher.reset();
+        return;
+    }
+    if (s_Watcher) return;
+
+    s_Watcher.reset(new FileWatcher());
+    for (Shader* shader : s_Shaders)
+        for (const SourcePaths& paths : shader->sourcePaths)
+            shader->watch(paths);
+}
+
+void Shader::UpdateAll()
+{
+    if (s_Watcher)
+    {
+        // Compared canonically: another pair may reach the same file through another spelling
+        for (const std::string& path : s_Watcher->PollChanged())
+        {
+            const std::string changed = FileWatcher::Canonical(path);
+            for (Shader* shader : s_Shaders)
+                shader->reload(changed);
+        }
+    }
+
+    for (Shader* shader : s_Shaders)
+        shader->pollCompile();
+}
+
+void Shader::ReleaseShared()
+{
+    s_Watcher.reset();
+    s_Fallbacks.clear();
+    s_DepthOnly[0].reset();
+    s_DepthOnly[1].reset();
+}
+
+UniformHandle::UniformHandle(const std::string& name)
+{
+    // Handles built from strings are few (sampler names and the like) and live
+    // as long as their owners, so interned names are simply never freed
+    static std::mutex mutex;
+    static std::unordered_set<std::string> names;
+    std::lock_guard<std::mutex> lock(mutex);
+    this->name = names.insert(name).first->c_str();
+    hash = Hash(this->name);
+}
+
+void Shader::cacheUniformLocations()
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    // Arrays get two names ("lights" and "lights[0]"); keep the load factor under 1/2
+    size_t capacity = 8;
+    while (capacity < static_cast<size_t>(count) * 4)
+        capacity *= 2;
+    uniformTable.assign(capacity, UniformSlot{0, -1, std::string()});
+    uniformCount = 0;
+
+    std::vector<char> name(static_cast<size_t>(std::max(maxLength, 1)));
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, &length, &size, &type, name.data());
+
+        // Members of uniform blocks have no location
+        GLint location = glGetUniformLocation(ID, name.data());
+        if (location < 0) continue;
+
+        insertUniform(name.data(), UniformHandle::Hash(name.data()), location);
+        std::string base(name.data(), static_cast<size_t>(length));
+        if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+        {
+            base.resize(base.size() - 3);
+            insertUniform(base.c_str(), UniformHandle::Hash(base.c_str()), location);
+        }
+    }
+}
+
+void Shader::insertUniform(const char* name, uint32_t hash, GLint location) const
+{
+    if ((uniformCount + 1) * 2 > uniformTable.size())
+    {
+        std::vector<UniformSlot> old = std::move(uniformTable);
+        uniformTable.assign(std::max<size_t>(old.size() * 2, 8), UniformSlot{0, -1, std::string()});
+        uniformCount = 0;
+        for (UniformSlot& slot : old)
+            if (slot.hash != 0) insertUniform(slot.name.c_str(), slot.hash, slot.location);
+    }
+
+    const size_t mask = uniformTable.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        UniformSlot& slot = uniformTable[i];
+        if (slot.hash == 0)
+        {
+            slot = {hash, location, name};
+            ++uniformCount;
+            return;
+        }
+        if (slot.hash == hash && slot.name == name) return;
+    }
+}
+
+GLint Shader::uniformLocation(UniformHandle handle) const
+{
+    if (!handle.name || uniformTable.empty()) return -1;
+    const size_t mask = uniformTable.size() - 1;
+    for (size_t i = handle.hash & mask;; i = (i + 1) & mask)
+    {
+        const UniformSlot& slot = uniformTable[i];
+        if (slot.hash == handle.hash && slot.name == handle.name) return slot.location;
+        if (slot.hash == 0) break;
+    }
+
+    // "lights[1]", "arr[2].member" and the like are not listed by
+    // glGetActiveUniform; ask the driver once and remember the answer, -1 included
+    GLint location = glGetUniformLocation(ID, handle.name);
+    insertUniform(handle.name, handle.hash, location);
+    return location;
 }
 
 void Shader::use()
 {
-    glUseProgram(ID);
+    GLState::UseProgram(ID);
 }
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setBool(UniformHandle(name.c_str()), value);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(UniformHandle(name.c_str()), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(UniformHandle(name.c_str()), value);
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& vec3) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &vec3[0]);
+    setVec3(UniformHandle(name.c_str()), vec3);
 }
 
 void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    setMat4(UniformHandle(name.c_str()), mat);
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const
+{
+    glUniform1i(uniformLocation(handle), (int)value);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const
+{
+    glUniform1i(uniformLocation(handle), value);
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const
+{
+    glUniform1f(uniformLocation(handle), value);
+}
+
+void Shader::setVec3(UniformHandle handle, const glm::vec3& vec3) const
+{
+    glUniform3fv(uniformLocation(handle), 1, &vec3[0]);
+}
+
+void Shader::setVec4(UniformHandle handle, const glm::vec4& vec4) const
+{
+    glUniform4fv(uniformLocation(handle), 1, &vec4[0]);
+}
+
+void Shader::setMat4(UniformHandle handle, const glm::mat4& mat) const
+{
+    glUniformMatrix4fv(uniformLocation(handle), 1, GL_FALSE, &mat[0][0]);
 }
 
-void Shader::checkCompileErrors(unsigned int shader, std::string type)
+bool Shader::checkCompileErrors(unsigned int shader, std::string type)
 {
     int success;
     char infoLog[1024];
@@ -111,4 +565,5 @@ void Shader::checkCompileErrors(unsigned int shader, std::string type)
                 "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
+    return success != 0;
 }
\ No newline at end of file
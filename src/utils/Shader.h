@@ -4,19 +4,64 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "RenderTypes.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+// Both stages of a vertex/fragment pair after #include and #define
+// processing, and every file they read
+struct ShaderSources
+{
+    std::string vertexCode;
+    std::string fragmentCode;
+    std::vector<std::string> files;
+};
 
 class Shader
 {
 public:
+    // The program to draw with. While the first compile is still running this
+    // is a shared fallback program, during a hot reload the previous one.
     unsigned int ID;
 
-    Shader(const char* vertexPath, const char* fragmentPath);
-    
+    // defines are injected after #version; #include "file" is resolved relative to each file
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
+    // sources already read from the two paths with ReadSources
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines, ShaderSources sources);
+    ~Shader();
+
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
     void use();
+    // False while ID is still the fallback program
+    bool isReady() const;
+
+    // Another pair of files with the same sources. An edit to its files
+    // reloads this program from that pair, as for the pair it was built from.
+    void addSourcePaths(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& files);
+    // What the program was last built from; sourceRevision changes with it
+    const ShaderSources& currentSources() const { return sources; }
+    unsigned sourceRevision() const { return revision; }
+
+    static bool ReadSources(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines,
+                            ShaderSources& sources);
+
+    // Compile new shaders in the background instead of blocking the constructor
+    static void SetAsyncCompilation(bool enabled);
+    // Recompile shaders when their .vs/.fs files change on disk
+    static void SetHotReload(bool enabled);
+    // Once per frame: starts recompiles for edited files and swaps in finished programs
+    static void UpdateAll();
+    // Position-only program for the depth pre-pass. Its gl_Position is
+    // invariant and computed exactly like mesh.vs, so GL_EQUAL passes match.
+    static Shader& DepthOnly(bool instanced);
+    // Drops the fallback and depth programs and the file watcher; call before the context goes away
+    static void ReleaseShared();
     
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
@@ -24,7 +69,73 @@ public:
     void setVec3(const std::string &name, const glm::vec3 &vec3) const;
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
+    // Hot-path setters: one table probe and a name compare, no driver query
+    // unless the name has not been looked up before
+    void setBool(UniformHandle handle, bool value) const;
+    void setInt(UniformHandle handle, int value) const;
+    void setFloat(UniformHandle handle, float value) const;
+    void setVec3(UniformHandle handle, const glm::vec3 &vec3) const;
+    void setVec4(UniformHandle handle, const glm::vec4 &vec4) const;
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const;
+
+    // -1 if the program has no such active uniform, like glGetUniformLocation
+    GLint uniformLocation(UniformHandle handle) const;
+
 private:
-    void checkCompileErrors(unsigned int shader, std::string type);
+    struct PendingProgram
+    {
+        GLuint program = 0;
+        GLuint vertex = 0;
+        GLuint fragment = 0;
+        uint64_t cacheKey = 0;
+        unsigned framesWaited = 0;
+    };
+
+    struct SourcePaths
+    {
+        std::string vertex;
+        std::string fragment;
+        // Both stages and everything they include, canonical, watched for hot reload
+        std::vector<std::string> files;
+    };
+    // The pair the program was built from first, then any added later
+    std::vector<SourcePaths> sourcePaths;
+    std::string defines;
+    ShaderSources sources;
+    unsigned revision = 0;
+    PendingProgram pending;
+    bool ownsProgram = false;
+
+    struct UniformSlot
+    {
+        uint32_t hash;
+        GLint location;
+        std::string name;
+    };
+    // Open-addressed, power-of-two sized. Filled with the active uniforms after
+    // linking; other names (array elements, struct members, misses) are added
+    // the first time they are looked up.
+    mutable std::vector<UniformSlot> uniformTable;
+    mutable size_t uniformCount = 0;
+
+    Shader();
+
+    void init(ShaderSources sources);
+    // Rereads sourcePaths[pair]; on success it becomes the current sources
+    bool readSources(size_t pair);
+    void watch(const SourcePaths& paths) const;
+    // Issues compile and link without querying any status
+    void beginCompile(const std::string &vertexCode, const std::string &fragmentCode, uint64_t cacheKey);
+    // Finishes the pending compile if the driver is done with it; true if it did
+    bool pollCompile();
+    void finishCompile();
+    void discardPending();
+    void adoptProgram(GLuint program);
+    void useFallback();
+    // changedFile picks the pair to rebuild from
+    void reload(const std::string& changedFile);
+    bool checkCompileErrors(unsigned int shader, std::string type);
+    void cacheUniformLocations();
+    void insertUniform(const char* name, uint32_t hash, GLint location) const;
 };
 #endif
\ No newline at end of file
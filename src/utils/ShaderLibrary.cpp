@@ -0,0 +1,135 @@
+#include "ShaderLibrary.h"
+#include "FileWatcher.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderLibraryEntry
+{
+    // Every path key that leads here, and the sources the program was last built from
+    std::vector<std::string> pathKeys;
+    std::string defines;
+    std::string sourceKey;
+    unsigned sourceRevision = 0;
+    std::unique_ptr<Shader> shader;
+    uint32_t refCount = 0;
+};
+
+// By canonical paths plus defines: the common case, no file reads
+static std::unordered_map<std::string, ShaderLibraryEntry*> s_ByPath;
+// By preprocessed sources plus defines, for the same shader reached through other files
+static std::unordered_map<std::string, ShaderLibraryEntry*> s_BySource;
+// Owns the entries
+static std::vector<std::unique_ptr<ShaderLibraryEntry>> s_Entries;
+
+// #line directives number files instead of naming them, so paths do not leak
+// into the text. '\0' cannot appear in GLSL, so it keeps the parts apart.
+static std::string SourceKey(const ShaderSources& sources, const std::string& defines)
+{
+    return sources.vertexCode + '\0' + sources.fragmentCode + '\0' + defines;
+}
+
+// Programs that hot-reloaded since they were keyed are filed under their new sources
+static void RefreshSourceKeys()
+{
+    for (const std::unique_ptr<ShaderLibraryEntry>& entry : s_Entries)
+    {
+        if (entry->sourceRevision == entry->shader->sourceRevision()) continue;
+        auto stale = s_BySource.find(entry->sourceKey);
+        if (stale != s_BySource.end() && stale->second == entry.get()) s_BySource.erase(stale);
+        entry->sourceKey = SourceKey(entry->shader->currentSources(), entry->defines);
+        entry->sourceRevision = entry->shader->sourceRevision();
+        s_BySource.emplace(entry->sourceKey, entry.get());
+    }
+}
+
+ShaderRef::ShaderRef(ShaderLibraryEntry* entry)
+    : entry(entry)
+{
+    if (entry) entry->refCount++;
+}
+
+ShaderRef::ShaderRef(const ShaderRef& other)
+    : ShaderRef(other.entry)
+{
+}
+
+ShaderRef::ShaderRef(ShaderRef&& other) noexcept
+    : entry(other.entry)
+{
+    other.entry = nullptr;
+}
+
+ShaderRef& ShaderRef::operator=(ShaderRef other) noexcept
+{
+    std::swap(entry, other.entry);
+    return *this;
+}
+
+ShaderRef::~ShaderRef()
+{
+    if (entry) ShaderLibrary::Release(entry);
+}
+
+Shader* ShaderRef::get() const
+{
+    return entry ? entry->shader.get() : nullptr;
+}
+
+ShaderRef ShaderLibrary::Load(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines)
+{
+    const std::string pathKey = FileWatcher::Canonical(vertexPath) + '\n' + FileWatcher::Canonical(fragmentPath) + '\n' + defines;
+    auto byPath = s_ByPath.find(pathKey);
+    if (byPath != s_ByPath.end()) return ShaderRef(byPath->second);
+
+    // New paths: read them once, and hand the result to the Shader if nothing matches
+    ShaderSources sources;
+    const bool readable = Shader::ReadSources(vertexPath, fragmentPath, defines, sources);
+    const std::string sourceKey = SourceKey(sources, defines);
+    if (readable)
+    {
+        RefreshSourceKeys();
+        auto bySource = s_BySource.find(sourceKey);
+        if (bySource != s_BySource.end())
+        {
+            ShaderLibraryEntry* entry = bySource->second;
+            // Edits to this caller's files reload the shared program too
+            entry->shader->addSourcePaths(vertexPath.c_str(), fragmentPath.c_str(), sources.files);
+            entry->pathKeys.push_back(pathKey);
+            s_ByPath.emplace(pathKey, entry);
+            return ShaderRef(entry);
+        }
+    }
+
+    // Unreadable for now: the Shader reports it, and it is shared by path only
+    std::unique_ptr<ShaderLibraryEntry> entry(new ShaderLibraryEntry());
+    entry->pathKeys.push_back(pathKey);
+    entry->defines = defines;
+    entry->shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines, std::move(sources)));
+    entry->sourceRevision = entry->shader->sourceRevision();
+    if (readable)
+    {
+        entry->sourceKey = sourceKey;
+        s_BySource.emplace(sourceKey, entry.get());
+    }
+    s_ByPath.emplace(pathKey, entry.get());
+    s_Entries.push_back(std::move(entry));
+    return ShaderRef(s_Entries.back().get());
+}
+
+size_t ShaderLibrary::ProgramCount()
+{
+    return s_Entries.size();
+}
+
+void ShaderLibrary::Release(ShaderLibraryEntry* entry)
+{
+    if (--entry->refCount > 0) return;
+    for (const std::string& pathKey : entry->pathKeys)
+        s_ByPath.erase(pathKey);
+    auto bySource = s_BySource.find(entry->sourceKey);
+    if (bySource != s_BySource.end() && bySource->second == entry) s_BySource.erase(bySource);
+    // Erasing destroys the entry, and with it the program
+    s_Entries.erase(std::find_if(s_Entries.begin(), s_Entries.end(),
+                                 [&](const std::unique_ptr<ShaderLibraryEntry>& owned) { return owned.get() == entry; }));
+}
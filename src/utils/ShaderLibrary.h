@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Shader.h"
+
+struct ShaderLibraryEntry;
+
+// Shared, refcounted reference to a program owned by the ShaderLibrary.
+// The program is deleted when the last reference goes away.
+class ShaderRef {
+public:
+    ShaderRef() = default;
+    ShaderRef(const ShaderRef& other);
+    ShaderRef(ShaderRef&& other) noexcept;
+    ShaderRef& operator=(ShaderRef other) noexcept;
+    ~ShaderRef();
+
+    Shader* get() const;
+    Shader* operator->() const { return get(); }
+    Shader& operator*() const { return *get(); }
+    explicit operator bool() const { return entry != nullptr; }
+
+private:
+    friend class ShaderLibrary;
+    explicit ShaderRef(ShaderLibraryEntry* entry);
+
+    ShaderLibraryEntry* entry = nullptr;
+};
+
+// Every program in the application, so fifty models with the same shader
+// pair compile it once. Programs are found by canonical paths plus defines,
+// and failing that by preprocessed sources plus defines, so a copy of a shader
+// or one reached through other files shares too. A shared program watches
+// every caller's files and hot-reloads from whichever pair was edited.
+// Every ShaderRef must be gone before the context is. GL thread only.
+class ShaderLibrary {
+public:
+    static ShaderRef Load(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines = "");
+
+    // Distinct programs currently alive
+    static size_t ProgramCount();
+
+private:
+    friend class ShaderRef;
+    static void Release(ShaderLibraryEntry* entry);
+};
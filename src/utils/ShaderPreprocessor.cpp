@@ -0,0 +1,102 @@
+#include "ShaderPreprocessor.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static constexpr int kMaxIncludeDepth = 16;
+
+static bool ReadFile(const std::string& path, std::string& text)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    text = stream.str();
+    return true;
+}
+
+// Returns the quoted file name if line is an #include directive
+static bool ParseInclude(const std::string& line, std::string& name)
+{
+    size_t p = line.find_first_not_of(" \t");
+    if (p == std::string::npos || line.compare(p, 8, "#include") != 0) return false;
+
+    size_t open = line.find('"', p + 8);
+    size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+    if (close == std::string::npos) return false;
+    name = line.substr(open + 1, close - open - 1);
+    return true;
+}
+
+static bool IsVersion(const std::string& line)
+{
+    size_t p = line.find_first_not_of(" \t");
+    return p != std::string::npos && line.compare(p, 8, "#version") == 0;
+}
+
+static bool Expand(const std::string& path, const std::string& defines, int depth,
+                   std::string& output, std::vector<std::string>& files)
+{
+    if (depth > kMaxIncludeDepth)
+    {
+        std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+        return false;
+    }
+
+    std::string text;
+    if (!ReadFile(path, text))
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+        return false;
+    }
+
+    const int fileIndex = static_cast<int>(files.size());
+    files.push_back(path);
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+    std::istringstream lines(text);
+    std::string line, name;
+    for (int lineNumber = 1; std::getline(lines, line); ++lineNumber)
+    {
+        if (depth == 0 && IsVersion(line))
+        {
+            output += line + "\n" + defines;
+            output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        }
+        else if (ParseInclude(line, name))
+        {
+            std::string includePath = (directory / name).lexically_normal().string();
+            // Include once: a second include of the same file expands to nothing
+            if (std::find(files.begin(), files.end(), includePath) == files.end())
+            {
+                output += "#line 1 " + std::to_string(files.size()) + "\n";
+                if (!Expand(includePath, defines, depth + 1, output, files)) return false;
+            }
+            output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        }
+        else
+        {
+            output += line + "\n";
+        }
+    }
+    return true;
+}
+
+bool ShaderPreprocessor::Process(const std::string& path, const std::string& defines,
+                                 std::string& output, std::vector<std::string>& files)
+{
+    output.clear();
+    files.clear();
+    return Expand(path, defines, 0, output, files);
+}
+
+std::string ShaderPreprocessor::InjectDefines(const std::string& source, const std::string& defines)
+{
+    size_t version = source.find("#version");
+    if (version == std::string::npos) return defines + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos) return source + "\n" + defines;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Expands `#include "file"` (relative to the including file, each file at
+// most once) and injects a block of #defines right after #version.
+// #line directives keep compiler errors pointing at the right file and line;
+// the source string number is the index into `files`.
+class ShaderPreprocessor {
+public:
+    // files is filled with every file read, the top-level one first, for hot reload
+    static bool Process(const std::string& path, const std::string& defines,
+                        std::string& output, std::vector<std::string>& files);
+
+    // For sources that do not come from a file
+    static std::string InjectDefines(const std::string& source, const std::string& defines);
+};
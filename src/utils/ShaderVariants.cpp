@@ -0,0 +1,30 @@
+#include "ShaderVariants.h"
+
+static const char* const kFeatureNames[] = {
+    "INSTANCED",
+    "TEXTURED",
+};
+
+std::string ShaderFeatureDefines(uint32_t features)
+{
+    std::string defines;
+    for (uint32_t bit = 0; bit < sizeof(kFeatureNames) / sizeof(kFeatureNames[0]); ++bit)
+    {
+        if (features & (1u << bit))
+            defines += std::string("#define ") + kFeatureNames[bit] + "\n";
+    }
+    return defines;
+}
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+}
+
+Shader& ShaderVariants::Get(uint32_t features)
+{
+    ShaderRef& variant = variants[features];
+    if (!variant)
+        variant = ShaderLibrary::Load(vertexPath, fragmentPath, ShaderFeatureDefines(features));
+    return *variant;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "Shader.h"
+#include "ShaderLibrary.h"
+
+// Compile-time feature switches. Each set bit becomes a #define in the
+// variant's sources, so a feature costs nothing on the GPU when it is off.
+enum ShaderFeature : uint32_t {
+    SHADER_FEATURE_INSTANCED = 1u << 0, // model matrix from attributes 5-8 instead of the model uniform
+    SHADER_FEATURE_TEXTURED  = 1u << 1, // texture coordinates passed to the fragment stage
+};
+
+// "#define INSTANCED\n" etc. for every bit in features
+std::string ShaderFeatureDefines(uint32_t features);
+
+// All permutations of one vertex/fragment pair. A variant is compiled the
+// first time it is asked for, so only feature sets actually used get built,
+// and comes from the ShaderLibrary, so other users of the pair share it.
+class ShaderVariants {
+public:
+    ShaderVariants(const char* vertexPath, const char* fragmentPath);
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    Shader& Get(uint32_t features);
+
+    const std::string& VertexPath() const { return vertexPath; }
+    const std::string& FragmentPath() const { return fragmentPath; }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::unordered_map<uint32_t, ShaderRef> variants;
+};
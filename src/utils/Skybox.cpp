@@ -1,9 +1,11 @@
 #include "Skybox.h"
 #include "stb_image.h"
+#include "GLState.h"
+#include "Profiler.h"
 #include <iostream>
 
 Skybox::Skybox(std::vector<std::string> faces, const char* vsPath, const char* fsPath) {
-    shader = new Shader(vsPath, fsPath);
+    shader = ShaderLibrary::Load(vsPath, fsPath);
     setupSkybox();
     textureID = loadCubemap(faces);
 
@@ -12,28 +14,27 @@ Skybox::Skybox(std::vector<std::string> faces, const char* vsPath, const char* f
 }
 
 Skybox::~Skybox() {
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    delete shader;
+    GLState::DeleteVertexArray(VAO);
+    GLState::DeleteBuffer(VBO);
+    GLState::DeleteTexture(textureID);
 }
 
-void Skybox::Draw(const glm::mat4& view, const glm::mat4& projection) {
-    glDepthFunc(GL_LEQUAL); 
-    
-    shader->use();
+void Skybox::Draw() {
+    PROFILE_SCOPE("Skybox::Draw");
+    // The fallback program has no skybox sampler; skip until the real one is in
+    if (!shader->isReady()) return;
 
-    glm::mat4 viewNoTrans = glm::mat4(glm::mat3(view)); 
+    // Depth is cleared to 1.0 and the skybox writes z = w, so it needs LEQUAL.
+    // Whoever draws next sets the depth func it needs.
+    GLState::DepthFunc(GL_LEQUAL);
+    // Seen from inside; single-sided meshes may have left back-face culling on
+    GLState::SetEnabled(GL_CULL_FACE, false);
     
-    shader->setMat4("view", viewNoTrans);
-    shader->setMat4("projection", projection);
+    shader->use();
 
-    glBindVertexArray(VAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::BindVertexArray(VAO);
+    GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-
-    glDepthFunc(GL_LESS);
 }
 
 void Skybox::setupSkybox() {
@@ -84,18 +85,18 @@ void Skybox::setupSkybox() {
 
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::BindVertexArray(VAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
 }
 
 unsigned int Skybox::loadCubemap(std::vector<std::string> faces) {
+    PROFILE_CPU_SCOPE("Skybox::loadCubemap");
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++) {
@@ -6,17 +6,19 @@
 #include <string>
 
 #include "Shader.h"
+#include "ShaderLibrary.h"
 
 class Skybox
 {
 public:
     unsigned int textureID;
-    Shader* shader;
+    ShaderRef shader;
 
     Skybox(std::vector<std::string> faces, const char* vsPath, const char* fsPath);
     ~Skybox();
 
-    void Draw(const glm::mat4& view, const glm::mat4& projection);
+    // Uses the CameraData uniform block, with the translation dropped in the shader
+    void Draw();
 
 private:
     unsigned int VAO, VBO;
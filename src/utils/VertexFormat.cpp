@@ -0,0 +1,127 @@
+#include "VertexFormat.h"
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint32_t ChooseVertexFormat(const Vertex* vertices, size_t count, uint32_t streams)
+{
+    bool normals = false, tangents = false, weights = false;
+    uint32_t format = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Vertex& v = vertices[i];
+        if (v.TexCoords.x < 0.0f || v.TexCoords.x > 1.0f || v.TexCoords.y < 0.0f || v.TexCoords.y > 1.0f)
+            format |= VERTEX_FORMAT_UV_HALF;
+        normals = normals || glm::dot(v.Normal, v.Normal) > 0.0f;
+        tangents = tangents || glm::dot(v.Tangent, v.Tangent) > 0.0f;
+        weights = weights || v.m_Weights[0] + v.m_Weights[1] + v.m_Weights[2] + v.m_Weights[3] > 0.0f;
+    }
+
+    if ((streams & VERTEX_FORMAT_QTANGENT) && tangents) format |= VERTEX_FORMAT_QTANGENT;
+    else if ((streams & (VERTEX_FORMAT_NORMAL | VERTEX_FORMAT_QTANGENT)) && normals) format |= VERTEX_FORMAT_NORMAL;
+    if ((streams & VERTEX_FORMAT_SKINNED) && weights) format |= VERTEX_FORMAT_SKINNED;
+    return format;
+}
+
+static int16_t ToSnorm16(float v)
+{
+    return static_cast<int16_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint16_t ToUnorm16(float v)
+{
+    return static_cast<uint16_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f));
+}
+
+static glm::vec3 SafeNormalize(const glm::vec3& v, const glm::vec3& fallback)
+{
+    float lengthSq = glm::dot(v, v);
+    return lengthSq > 1e-12f ? v / std::sqrt(lengthSq) : fallback;
+}
+
+// Octahedral mapping: project onto |x|+|y|+|z| = 1 and fold the lower half outwards
+static glm::vec2 OctEncode(const glm::vec3& n)
+{
+    glm::vec2 p = glm::vec2(n) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if (n.z < 0.0f)
+    {
+        glm::vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+    }
+    return p;
+}
+
+// Tangent frame as a unit quaternion; the sign of w carries the bitangent handedness
+static glm::quat QTangentEncode(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent)
+{
+    glm::vec3 n = SafeNormalize(normal, glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::vec3 t = tangent - n * glm::dot(n, tangent);
+    if (glm::dot(t, t) < 1e-12f)
+        t = std::abs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+    t = glm::normalize(t);
+    glm::vec3 b = glm::cross(n, t);
+    const bool reflected = glm::dot(b, bitangent) < 0.0f;
+
+    glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+    if (q.w < 0.0f) q = -q;
+    // Keep w away from zero, so its sign survives snorm16 quantization
+    const float bias = 1.0f / 32767.0f;
+    if (q.w < bias)
+    {
+        float scale = std::sqrt(1.0f - bias * bias);
+        q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+    }
+    return reflected ? -q : q;
+}
+
+void EncodeVertices(uint32_t format, const Vertex* vertices, size_t count, uint8_t* out)
+{
+    const VertexLayout& layout = GetVertexLayout(format);
+    for (size_t i = 0; i < count; ++i, out += layout.stride)
+    {
+        const Vertex& v = vertices[i];
+        uint8_t* p = out;
+
+        std::memcpy(p, &v.Position, 12);
+        p += 12;
+
+        if (format & VERTEX_FORMAT_QTANGENT)
+        {
+            glm::quat q = QTangentEncode(v.Normal, v.Tangent, v.Bitangent);
+            int16_t packed[4] = {ToSnorm16(q.x), ToSnorm16(q.y), ToSnorm16(q.z), ToSnorm16(q.w)};
+            std::memcpy(p, packed, 8);
+            p += 8;
+        }
+        else if (format & VERTEX_FORMAT_NORMAL)
+        {
+            glm::vec2 oct = OctEncode(SafeNormalize(v.Normal, glm::vec3(0.0f, 0.0f, 1.0f)));
+            int16_t packed[2] = {ToSnorm16(oct.x), ToSnorm16(oct.y)};
+            std::memcpy(p, packed, 4);
+            p += 4;
+        }
+
+        uint16_t uv[2];
+        if (format & VERTEX_FORMAT_UV_HALF)
+        {
+            uv[0] = glm::packHalf1x16(v.TexCoords.x);
+            uv[1] = glm::packHalf1x16(v.TexCoords.y);
+        }
+        else
+        {
+            uv[0] = ToUnorm16(v.TexCoords.x);
+            uv[1] = ToUnorm16(v.TexCoords.y);
+        }
+        std::memcpy(p, uv, 4);
+        p += 4;
+
+        if (format & VERTEX_FORMAT_SKINNED)
+        {
+            for (int j = 0; j < 4; ++j)
+                p[j] = static_cast<uint8_t>(std::clamp(v.m_BoneIDs[j], 0, 255));
+            for (int j = 0; j < 4; ++j)
+                p[4 + j] = static_cast<uint8_t>(std::lround(std::clamp(v.m_Weights[j], 0.0f, 1.0f) * 255.0f));
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "RenderTypes.h"
+#include "VertexLayout.h"
+
+// Compact GPU encodings of Vertex, chosen per mesh at import.
+//
+//   location 0  position       float3                      12 bytes
+//   location 1  normal         octahedral snorm16x2         4 bytes  (NORMAL)
+//   location 3  QTangent       snorm16x4 quaternion         8 bytes  (QTANGENT)
+//   location 2  uv             unorm16x2, or half2 if any    4 bytes
+//                              coordinate is outside [0, 1]
+//   location 9  bone ids       uint8x4 (integer attribute)  4 bytes  (SKINNED)
+//   location 10 bone weights   unorm8x4                     4 bytes  (SKINNED)
+//
+// That is 16-32 bytes per vertex instead of the 88 of Vertex. A stream is
+// only uploaded when the mesh's shader reads it and the mesh has the data,
+// so unlit meshes keep 16 bytes. Shaders decode normals and tangent frames
+// with the helpers in vertex_decode.glsl.
+enum VertexFormatFlags : uint32_t {
+    VERTEX_FORMAT_UV_HALF  = 1u << 0,
+    VERTEX_FORMAT_NORMAL   = 1u << 1,
+    VERTEX_FORMAT_QTANGENT = 1u << 2,   // full tangent frame, normal included; never with NORMAL
+    VERTEX_FORMAT_SKINNED  = 1u << 3,
+};
+constexpr uint32_t kVertexFormatCount = 16;
+
+// The bits a shader asks for (Model's vertexStreams); UV_HALF depends on the data alone
+constexpr uint32_t kVertexStreamFlags = VERTEX_FORMAT_NORMAL | VERTEX_FORMAT_QTANGENT | VERTEX_FORMAT_SKINNED;
+
+constexpr VertexLayout MakeCompactVertexLayout(uint32_t format)
+{
+    VertexLayout layout;
+    GLuint offset = 0;
+    auto add = [&](const VertexAttribute& attribute, GLuint size) {
+        layout.attributes[layout.attributeCount++] = attribute;
+        offset += size;
+    };
+
+    add(MakeVertexAttribute<glm::vec3>(VERTEX_LOCATION_POSITION, offset), 12);
+    if (format & VERTEX_FORMAT_QTANGENT) add(MakeVertexAttribute<Snorm16x4>(VERTEX_LOCATION_TANGENT, offset), 8);
+    else if (format & VERTEX_FORMAT_NORMAL) add(MakeVertexAttribute<Snorm16x2>(VERTEX_LOCATION_NORMAL, offset), 4);
+    if (format & VERTEX_FORMAT_UV_HALF) add(MakeVertexAttribute<Half2>(VERTEX_LOCATION_TEXCOORD, offset), 4);
+    else add(MakeVertexAttribute<Unorm16x2>(VERTEX_LOCATION_TEXCOORD, offset), 4);
+    if (format & VERTEX_FORMAT_SKINNED)
+    {
+        add(MakeVertexAttribute<UInt8x4>(VERTEX_LOCATION_BONE_IDS, offset), 4);
+        add(MakeVertexAttribute<Unorm8x4>(VERTEX_LOCATION_BONE_WEIGHTS, offset), 4);
+    }
+
+    layout.stride = offset;
+    return layout;
+}
+
+// Built at compile time; indexed by VertexFormatFlags
+inline constexpr VertexLayout kCompactVertexLayouts[kVertexFormatCount] = {
+    MakeCompactVertexLayout(0),  MakeCompactVertexLayout(1),  MakeCompactVertexLayout(2),  MakeCompactVertexLayout(3),
+    MakeCompactVertexLayout(4),  MakeCompactVertexLayout(5),  MakeCompactVertexLayout(6),  MakeCompactVertexLayout(7),
+    MakeCompactVertexLayout(8),  MakeCompactVertexLayout(9),  MakeCompactVertexLayout(10), MakeCompactVertexLayout(11),
+    MakeCompactVertexLayout(12), MakeCompactVertexLayout(13), MakeCompactVertexLayout(14), MakeCompactVertexLayout(15),
+};
+static_assert(kCompactVertexLayouts[0].stride == 16 && kCompactVertexLayouts[VERTEX_FORMAT_NORMAL].stride == 20 &&
+              kCompactVertexLayouts[VERTEX_FORMAT_QTANGENT | VERTEX_FORMAT_SKINNED].stride == 32,
+              "compact vertex sizes changed");
+
+inline const VertexLayout& GetVertexLayout(uint32_t format)
+{
+    return kCompactVertexLayouts[format & (kVertexFormatCount - 1)];
+}
+
+// Inverse of GetVertexLayout; false for layouts that are not a compact format
+inline bool FindVertexFormat(const VertexLayout& layout, uint32_t& format)
+{
+    for (uint32_t f = 0; f < kVertexFormatCount; f++)
+    {
+        if (&layout != &kCompactVertexLayouts[f]) continue;
+        format = f;
+        return true;
+    }
+    return false;
+}
+
+// Smallest format that keeps what the vertices carry and streams (kVertexStreamFlags
+// bits) asks for. QTANGENT falls back to NORMAL for meshes without tangents,
+// SKINNED is dropped for meshes without bone weights.
+uint32_t ChooseVertexFormat(const Vertex* vertices, size_t count, uint32_t streams = 0);
+
+// Writes count vertices in format to out, which must hold count * stride bytes
+void EncodeVertices(uint32_t format, const Vertex* vertices, size_t count, uint8_t* out);
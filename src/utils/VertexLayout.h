@@ -0,0 +1,144 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+// Attribute locations shared by every vertex layout and shader.
+// 5-8 are taken by the per-instance model matrix.
+enum VertexLocation : GLuint {
+    VERTEX_LOCATION_POSITION     = 0,
+    VERTEX_LOCATION_NORMAL       = 1,
+    VERTEX_LOCATION_TEXCOORD     = 2,
+    VERTEX_LOCATION_TANGENT      = 3,
+    VERTEX_LOCATION_BITANGENT    = 4,
+    VERTEX_LOCATION_BONE_IDS     = 9,
+    VERTEX_LOCATION_BONE_WEIGHTS = 10,
+    VERTEX_LOCATION_COLOR        = 11,
+};
+
+// Packed member types. The member's C++ type decides how GL reads it, so a
+// layout table cannot disagree with the struct it describes.
+struct Snorm16x2 { int16_t x, y; };
+struct Snorm16x4 { int16_t x, y, z, w; };
+struct Unorm16x2 { uint16_t x, y; };
+struct Half2     { uint16_t x, y; };
+struct UInt8x4   { uint8_t x, y, z, w; };     // integer attribute (uvec4)
+struct Unorm8x4  { uint8_t x, y, z, w; };
+
+struct VertexAttribute {
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    bool integer;       // glVertexAttribIPointer rather than glVertexAttribPointer
+    GLuint offset;
+};
+
+constexpr unsigned int kMaxVertexAttributes = 8;
+
+struct VertexLayout {
+    VertexAttribute attributes[kMaxVertexAttributes] = {};
+    unsigned int attributeCount = 0;
+    GLuint stride = 0;
+
+    constexpr VertexLayout() = default;
+    constexpr VertexLayout(GLuint stride, std::initializer_list<VertexAttribute> list)
+        : stride(stride)
+    {
+        for (const VertexAttribute& a : list)
+            attributes[attributeCount++] = a;
+    }
+};
+
+constexpr GLuint VertexAttributeSize(const VertexAttribute& a)
+{
+    GLuint componentSize = 4;
+    if (a.type == GL_SHORT || a.type == GL_UNSIGNED_SHORT || a.type == GL_HALF_FLOAT) componentSize = 2;
+    else if (a.type == GL_BYTE || a.type == GL_UNSIGNED_BYTE) componentSize = 1;
+    return componentSize * static_cast<GLuint>(a.components);
+}
+
+template <typename T> struct AttributeFormat;
+#define VERTEX_ATTRIBUTE_FORMAT(T, components, type, normalized, integer) \
+    template <> struct AttributeFormat<T> { \
+        static constexpr GLint kComponents = components; \
+        static constexpr GLenum kType = type; \
+        static constexpr GLboolean kNormalized = normalized; \
+        static constexpr bool kInteger = integer; \
+    };
+VERTEX_ATTRIBUTE_FORMAT(float,     1, GL_FLOAT,          GL_FALSE, false)
+VERTEX_ATTRIBUTE_FORMAT(glm::vec2, 2, GL_FLOAT,          GL_FALSE, false)
+VERTEX_ATTRIBUTE_FORMAT(glm::vec3, 3, GL_FLOAT,          GL_FALSE, false)
+VERTEX_ATTRIBUTE_FORMAT(glm::vec4, 4, GL_FLOAT,          GL_FALSE, false)
+VERTEX_ATTRIBUTE_FORMAT(int[4],    4, GL_INT,            GL_FALSE, true)
+VERTEX_ATTRIBUTE_FORMAT(float[4],  4, GL_FLOAT,          GL_FALSE, false)
+VERTEX_ATTRIBUTE_FORMAT(Snorm16x2, 2, GL_SHORT,          GL_TRUE,  false)
+VERTEX_ATTRIBUTE_FORMAT(Snorm16x4, 4, GL_SHORT,          GL_TRUE,  false)
+VERTEX_ATTRIBUTE_FORMAT(Unorm16x2, 2, GL_UNSIGNED_SHORT, GL_TRUE,  false)
+VERTEX_ATTRIBUTE_FORMAT(Half2,     2, GL_HALF_FLOAT,     GL_FALSE, false)
+VERTEX_ATTRIBUTE_FORMAT(UInt8x4,   4, GL_UNSIGNED_BYTE,  GL_FALSE, true)
+VERTEX_ATTRIBUTE_FORMAT(Unorm8x4,  4, GL_UNSIGNED_BYTE,  GL_TRUE,  false)
+#undef VERTEX_ATTRIBUTE_FORMAT
+
+template <typename T>
+constexpr VertexAttribute MakeVertexAttribute(GLuint location, size_t offset)
+{
+    return {location, AttributeFormat<T>::kComponents, AttributeFormat<T>::kType,
+            AttributeFormat<T>::kNormalized, AttributeFormat<T>::kInteger, static_cast<GLuint>(offset)};
+}
+
+// One entry of a VertexTraits table: VERTEX_ATTRIBUTE(MyVertex, Position, VERTEX_LOCATION_POSITION)
+#define VERTEX_ATTRIBUTE(Type, member, location) \
+    MakeVertexAttribute<decltype(Type::member)>(location, offsetof(Type, member))
+
+// Specialize for every vertex struct a Mesh is built from:
+//     template <> struct VertexTraits<MyVertex> {
+//         static constexpr VertexLayout layout{sizeof(MyVertex), {VERTEX_ATTRIBUTE(...), ...}};
+//     };
+// Position must be a glm::vec3 at VERTEX_LOCATION_POSITION; bounds and
+// culling read it back from the CPU copy.
+template <typename V> struct VertexTraits;
+
+template <typename V>
+constexpr const VertexLayout& LayoutOf()
+{
+    return VertexTraits<V>::layout;
+}
+
+template <typename V>
+constexpr bool HasFloat3Position()
+{
+    for (unsigned int i = 0; i < LayoutOf<V>().attributeCount; ++i)
+    {
+        const VertexAttribute& a = LayoutOf<V>().attributes[i];
+        if (a.location == VERTEX_LOCATION_POSITION)
+            return a.type == GL_FLOAT && a.components == 3;
+    }
+    return false;
+}
+
+// Lines, debug geometry
+struct PositionVertex {
+    glm::vec3 Position;
+};
+
+struct PositionColorVertex {
+    glm::vec3 Position;
+    Unorm8x4 Color;
+};
+
+template <> struct VertexTraits<PositionVertex> {
+    static constexpr VertexLayout layout{sizeof(PositionVertex), {
+        VERTEX_ATTRIBUTE(PositionVertex, Position, VERTEX_LOCATION_POSITION),
+    }};
+};
+
+template <> struct VertexTraits<PositionColorVertex> {
+    static constexpr VertexLayout layout{sizeof(PositionColorVertex), {
+        VERTEX_ATTRIBUTE(PositionColorVertex, Position, VERTEX_LOCATION_POSITION),
+        VERTEX_ATTRIBUTE(PositionColorVertex, Color, VERTEX_LOCATION_COLOR),
+    }};
+};
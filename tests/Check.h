@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertions for the CPU-side tests. A failed CHECK reports and keeps
+// going, so one run lists every failure; main returns CheckResult().
+inline int& CheckFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(expr)                                                                  \
+    do {                                                                             \
+        if (!(expr)) {                                                               \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);     \
+            CheckFailures()++;                                                       \
+        }                                                                            \
+    } while (0)
+
+inline int CheckResult()
+{
+    if (CheckFailures() > 0) std::printf("%d check(s) failed\n", CheckFailures());
+    return CheckFailures() > 0 ? 1 : 0;
+}
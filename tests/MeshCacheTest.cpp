@@ -0,0 +1,257 @@
+#include "Check.h"
+#include "TestMeshes.h"
+#include "utils/MeshCache.h"
+#include "utils/MeshOptimizer.h"
+#include "utils/MeshSimplifier.h"
+#include "utils/VertexFormat.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+// A mesh through the import passes, in the form the cache stores
+struct ImportedMesh {
+    TestMesh mesh;
+    uint32_t format = 0;
+    std::vector<uint8_t> vertexData;
+    std::vector<glm::vec3> positions;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+};
+
+static ImportedMesh Import(TestMesh mesh, uint32_t vertexStreams = 0)
+{
+    ImportedMesh imported;
+    MeshOptimizer::Optimize(mesh.vertices, mesh.indices);
+    imported.lods = MeshSimplifier::BuildLodChain(mesh.vertices, mesh.indices);
+    imported.meshlets = MeshOptimizer::BuildMeshlets(mesh.vertices, mesh.indices, imported.lods[0].indexCount);
+    imported.format = ChooseVertexFormat(mesh.vertices.data(), mesh.vertices.size(), vertexStreams);
+    imported.vertexData.resize(mesh.vertices.size() * GetVertexLayout(imported.format).stride);
+    EncodeVertices(imported.format, mesh.vertices.data(), mesh.vertices.size(), imported.vertexData.data());
+    for (const Vertex& v : mesh.vertices) imported.positions.push_back(v.Position);
+    imported.mesh = std::move(mesh);
+    return imported;
+}
+
+static MeshCacheMeshData Describe(const ImportedMesh& imported)
+{
+    MeshCacheMeshData data;
+    data.vertexFormat = imported.format;
+    data.drawMode = 4; // GL_TRIANGLES
+    data.doubleSided = false;
+    for (const glm::vec3& p : imported.positions) data.bounds.Expand(p);
+    data.boundingSphere.center = data.bounds.Center();
+    data.boundingSphere.radius = glm::length(data.bounds.Extents());
+    data.textures = {0, 1};
+    data.vertexData = imported.vertexData.data();
+    data.vertexDataSize = imported.vertexData.size();
+    data.positions = imported.positions.data();
+    data.vertexCount = static_cast<uint32_t>(imported.positions.size());
+    data.indices = imported.mesh.indices.data();
+    data.indexCount = static_cast<uint32_t>(imported.mesh.indices.size());
+    data.lods = imported.lods.data();
+    data.lodCount = static_cast<uint32_t>(imported.lods.size());
+    data.meshlets = imported.meshlets.data();
+    data.meshletCount = static_cast<uint32_t>(imported.meshlets.size());
+    return data;
+}
+
+template <typename T>
+static bool SameArray(const MeshCache& cache, uint64_t offset, const T* expected, size_t count)
+{
+    return count == 0 || std::memcmp(cache.At<T>(offset), expected, count * sizeof(T)) == 0;
+}
+
+static std::vector<char> ReadFile(const fs::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const fs::path& path, const std::vector<char>& bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// The single entry in the cache directory
+static fs::path EntryFile(const fs::path& directory)
+{
+    fs::path entry;
+    for (const fs::directory_entry& file : fs::directory_iterator(directory))
+        if (file.path().extension() == ".mesh") entry = file.path();
+    return entry;
+}
+
+static bool OnlyEntryFiles(const fs::path& directory)
+{
+    for (const fs::directory_entry& file : fs::directory_iterator(directory))
+        if (file.path().extension() != ".mesh") return false;
+    return true;
+}
+
+int main()
+{
+    const fs::path root = fs::temp_directory_path() / "assignment1_mesh_cache_test";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    const fs::path cacheDirectory = root / "cache";
+    MeshCache::SetDirectory(cacheDirectory.string());
+
+    const std::string source = (root / "sphere.obj").string();
+    WriteFile(source, {'o', ' ', 's', 'p', 'h', 'e', 'r', 'e', '\n'});
+
+    const ImportedMesh sphere = Import(MakeSphere(48, 24));
+    CHECK(sphere.lods.size() >= 2 && !sphere.meshlets.empty());
+    const char embedded[] = "encoded image";
+
+    MeshCacheContents contents;
+    contents.flags = MESH_CACHE_TRANSPARENT;
+    contents.textures.resize(2);
+    contents.textures[0].type = "texture_diffuse";
+    contents.textures[0].path = "*0";
+    contents.textures[0].image.data = embedded;
+    contents.textures[0].image.size = sizeof(embedded);
+    contents.textures[1].type = "texture_normal";
+    contents.textures[1].path = "normal.png";
+    contents.meshes.push_back(Describe(sphere));
+    // A second reference to the same geometry stores no arrays
+    MeshCacheMeshData shared;
+    shared.sharedWith = 0;
+    shared.textures = {1};
+    contents.meshes.push_back(shared);
+
+    // Nothing is cached yet, and a missing source is neither read nor written
+    CHECK(!MeshCache::Open(source));
+    CHECK(!MeshCache::Write((root / "missing.obj").string(), contents));
+
+    // Store, then open: everything comes back exactly as written
+    CHECK(MeshCache::Write(source, contents));
+    CHECK(OnlyEntryFiles(cacheDirectory));
+    {
+        std::unique_ptr<MeshCache> cache = MeshCache::Open(source);
+        CHECK(cache != nullptr);
+        if (!cache) return CheckResult();
+
+        const MeshCacheHeader& header = cache->Header();
+        CHECK(header.version == MeshCache::kVersion);
+        CHECK(header.flags == MESH_CACHE_TRANSPARENT);
+        CHECK(header.meshCount == 2 && header.textureCount == 2);
+        CHECK(header.fileSize == fs::file_size(EntryFile(cacheDirectory)));
+
+        const MeshCacheTexture& diffuse = cache->TextureRecord(0);
+        CHECK(cache->String(diffuse.typeOffset, diffuse.typeLength) == "texture_diffuse");
+        CHECK(cache->String(diffuse.pathOffset, diffuse.pathLength) == "*0");
+        CHECK(diffuse.imageSize == sizeof(embedded) && SameArray(*cache, diffuse.imageOffset, embedded, sizeof(embedded)));
+        const MeshCacheTexture& normal = cache->TextureRecord(1);
+        CHECK(cache->String(normal.pathOffset, normal.pathLength) == "normal.png" && normal.imageSize == 0);
+
+        const MeshCacheMeshData& expected = contents.meshes[0];
+        const MeshCacheMesh& mesh = cache->MeshRecord(0);
+        CHECK(mesh.sharedWith == -1 && mesh.vertexFormat == expected.vertexFormat);
+        CHECK(mesh.drawMode == expected.drawMode && mesh.doubleSided == 0);
+        CHECK(mesh.bounds.min == expected.bounds.min && mesh.bounds.max == expected.bounds.max);
+        CHECK(mesh.boundingSphere.radius == expected.boundingSphere.radius);
+        CHECK(mesh.vertexCount == expected.vertexCount && mesh.indexCount == expected.indexCount);
+        CHECK(mesh.lodCount == expected.lodCount && mesh.meshletCount == expected.meshletCount);
+        CHECK(SameArray(*cache, mesh.vertexDataOffset, sphere.vertexData.data(), sphere.vertexData.size()));
+        CHECK(SameArray(*cache, mesh.positionsOffset, sphere.positions.data(), sphere.positions.size()));
+        CHECK(SameArray(*cache, mesh.indicesOffset, sphere.mesh.indices.data(), sphere.mesh.indices.size()));
+        CHECK(SameArray(*cache, mesh.lodsOffset, sphere.lods.data(), sphere.lods.size()));
+        CHECK(SameArray(*cache, mesh.meshletsOffset, sphere.meshlets.data(), sphere.meshlets.size()));
+        CHECK(mesh.textureCount == 2 && cache->At<uint32_t>(mesh.texturesOffset)[1] == 1);
+
+        const MeshCacheMesh& instance = cache->MeshRecord(1);
+        CHECK(instance.sharedWith == 0 && instance.vertexCount == 0 && instance.indexCount == 0);
+        CHECK(instance.textureCount == 1 && cache->At<uint32_t>(instance.texturesOffset)[0] == 1);
+    }
+
+    // Writing the same contents again gives the same bytes
+    const fs::path entry = EntryFile(cacheDirectory);
+    const std::vector<char> written = ReadFile(entry);
+    CHECK(MeshCache::Write(source, contents));
+    CHECK(ReadFile(entry) == written);
+
+    // Damaged entries miss instead of handing out-of-range data to the renderer
+    auto rejects = [&](auto&& damage) {
+        std::vector<char> bytes = written;
+        damage(bytes);
+        WriteFile(entry, bytes);
+        const bool rejected = MeshCache::Open(source) == nullptr;
+        WriteFile(entry, written);
+        return rejected;
+    };
+    auto header = [](std::vector<char>& bytes) { return reinterpret_cast<MeshCacheHeader*>(bytes.data()); };
+    auto meshRecord = [&](std::vector<char>& bytes, uint32_t index) {
+        return reinterpret_cast<MeshCacheMesh*>(bytes.data() + header(bytes)->meshesOffset) + index;
+    };
+
+    CHECK(!rejects([](std::vector<char>&) {}));
+    CHECK(rejects([](std::vector<char>& bytes) { bytes.resize(bytes.size() - 16); }));
+    CHECK(rejects([](std::vector<char>& bytes) { bytes.resize(sizeof(MeshCacheHeader) - 1); }));
+    CHECK(rejects([&](std::vector<char>& bytes) { header(bytes)->magic ^= 1; }));
+    CHECK(rejects([&](std::vector<char>& bytes) { header(bytes)->version = MeshCache::kVersion + 1; }));
+    CHECK(rejects([&](std::vector<char>& bytes) { header(bytes)->meshCount = 1000; }));
+    CHECK(rejects([&](std::vector<char>& bytes) { meshRecord(bytes, 0)->vertexFormat = kVertexFormatCount; }));
+    // Streams the entry was not written for, and two normal encodings at once
+    CHECK(rejects([&](std::vector<char>& bytes) { meshRecord(bytes, 0)->vertexFormat |= VERTEX_FORMAT_NORMAL; }));
+    CHECK(rejects([&](std::vector<char>& bytes) {
+        header(bytes)->vertexStreams = kVertexStreamFlags;
+        meshRecord(bytes, 0)->vertexFormat |= VERTEX_FORMAT_NORMAL | VERTEX_FORMAT_QTANGENT;
+    }));
+    CHECK(rejects([&](std::vector<char>& bytes) { meshRecord(bytes, 0)->indicesOffset += 8; }));
+    CHECK(rejects([&](std::vector<char>& bytes) { meshRecord(bytes, 0)->indexCount = 1u << 30; }));
+    CHECK(rejects([&](std::vector<char>& bytes) { meshRecord(bytes, 1)->sharedWith = 1; }));
+    CHECK(rejects([&](std::vector<char>& bytes) {
+        MeshCacheMesh* mesh = meshRecord(bytes, 1);
+        reinterpret_cast<uint32_t*>(bytes.data() + mesh->texturesOffset)[0] = 2;
+    }));
+    CHECK(rejects([&](std::vector<char>& bytes) {
+        MeshCacheMesh* mesh = meshRecord(bytes, 0);
+        reinterpret_cast<MeshLod*>(bytes.data() + mesh->lodsOffset)[mesh->lodCount - 1].indexCount += 3;
+    }));
+    CHECK(rejects([&](std::vector<char>& bytes) {
+        MeshCacheMesh* mesh = meshRecord(bytes, 0);
+        Meshlet* meshlets = reinterpret_cast<Meshlet*>(bytes.data() + mesh->meshletsOffset);
+        meshlets[mesh->meshletCount - 1].firstIndex = mesh->indexCount;
+        meshlets[mesh->meshletCount - 1].indexCount = 3;
+    }));
+
+    // Entries are per set of vertex streams: a model whose shader reads
+    // normals neither gets nor replaces the position+uv entry
+    {
+        CHECK(!MeshCache::Open(source, VERTEX_FORMAT_NORMAL));
+        const ImportedMesh litSphere = Import(MakeSphere(48, 24), VERTEX_FORMAT_NORMAL);
+        CHECK(litSphere.format == VERTEX_FORMAT_NORMAL);
+        MeshCacheContents lit = contents;
+        lit.vertexStreams = VERTEX_FORMAT_NORMAL;
+        lit.meshes[0] = Describe(litSphere);
+        CHECK(MeshCache::Write(source, lit));
+        std::unique_ptr<MeshCache> litCache = MeshCache::Open(source, VERTEX_FORMAT_NORMAL);
+        CHECK(litCache && litCache->Header().vertexStreams == VERTEX_FORMAT_NORMAL);
+        CHECK(litCache && litCache->MeshRecord(0).vertexFormat == VERTEX_FORMAT_NORMAL);
+        CHECK(ReadFile(entry) == written);
+        CHECK(MeshCache::Open(source) != nullptr);
+        litCache.reset();
+        for (const fs::directory_entry& file : fs::directory_iterator(cacheDirectory))
+            if (file.path() != entry) fs::remove(file.path());
+    }
+
+    // An edited source misses until it is written again
+    WriteFile(source, {'o', ' ', 'e', 'd', 'i', 't', 'e', 'd', ' ', 's', 'p', 'h', 'e', 'r', 'e', '\n'});
+    CHECK(!MeshCache::Open(source));
+    CHECK(MeshCache::Write(source, contents));
+    CHECK(MeshCache::Open(source) != nullptr);
+
+    // A failed write reports it and leaves nothing behind
+    const fs::path blocked = root / "blocked";
+    WriteFile(blocked, {'x'});
+    MeshCache::SetDirectory((blocked / "cache").string());
+    CHECK(!MeshCache::Write(source, contents));
+    CHECK(OnlyEntryFiles(cacheDirectory));
+
+    fs::remove_all(root);
+    return CheckResult();
+}
@@ -0,0 +1,174 @@
+#include "Check.h"
+#include "TestMeshes.h"
+#include "utils/MeshOptimizer.h"
+#include <numeric>
+
+static TestMesh ShuffledGrid()
+{
+    TestMesh mesh = MakeGrid(24, 24, [](float x, float z) { return 0.1f * std::sin(x * 9.0f) * std::cos(z * 7.0f); });
+    ShuffleTriangles(mesh.indices, 7);
+    return mesh;
+}
+
+static bool SameIndexTriangles(std::vector<unsigned int> a, std::vector<unsigned int> b)
+{
+    // Triangles as index triples rotated to their smallest index, then sorted
+    auto canonical = [](std::vector<unsigned int>& indices) {
+        std::vector<std::array<unsigned int, 3>> triangles;
+        for (size_t i = 0; i + 3 <= indices.size(); i += 3)
+        {
+            std::array<unsigned int, 3> t = {indices[i], indices[i + 1], indices[i + 2]};
+            std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+            triangles.push_back(t);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    };
+    return canonical(a) == canonical(b);
+}
+
+int main()
+{
+    // Each pass keeps the same triangles with the same winding
+    {
+        TestMesh mesh = ShuffledGrid();
+        std::vector<unsigned int> indices = mesh.indices;
+        const float before = MeshOptimizer::AverageCacheMissRatio(indices, mesh.vertices.size());
+        MeshOptimizer::OptimizeVertexCache(indices, mesh.vertices.size());
+        CHECK(SameIndexTriangles(indices, mesh.indices));
+        const float after = MeshOptimizer::AverageCacheMissRatio(indices, mesh.vertices.size());
+        CHECK(after < before);
+        // A regular grid gets well under one transform per triangle
+        CHECK(after < 0.9f);
+
+        std::vector<glm::vec3> positions;
+        for (const Vertex& v : mesh.vertices) positions.push_back(v.Position);
+        std::vector<unsigned int> cacheOrder = indices;
+        const float threshold = 1.05f;
+        MeshOptimizer::OptimizeOverdraw(indices, positions, threshold);
+        CHECK(SameIndexTriangles(indices, cacheOrder));
+        CHECK(MeshOptimizer::AverageCacheMissRatio(indices, mesh.vertices.size()) <= after * threshold + 1e-4f);
+    }
+
+    // Vertex fetch renumbers in first-use order and reports unused vertices
+    {
+        std::vector<unsigned int> indices = {4, 2, 0, 0, 2, 5};
+        std::vector<unsigned int> remap;
+        const size_t used = MeshOptimizer::OptimizeVertexFetch(indices, 6, remap);
+        CHECK(used == 4);
+        CHECK((indices == std::vector<unsigned int>{0, 1, 2, 2, 1, 3}));
+        CHECK(remap[4] == 0 && remap[2] == 1 && remap[0] == 2 && remap[5] == 3);
+        CHECK(remap[1] == ~0u && remap[3] == ~0u);
+    }
+
+    // The full pipeline draws the same triangles from fewer or equal vertices
+    {
+        TestMesh mesh = ShuffledGrid();
+        // An unused vertex, which Optimize drops
+        mesh.vertices.push_back(Vertex());
+        const auto triangles = TriangleSet(mesh.vertices, mesh.indices);
+        const size_t indexCount = mesh.indices.size();
+        MeshOptimizer::Optimize(mesh.vertices, mesh.indices);
+        CHECK(mesh.indices.size() == indexCount);
+        CHECK(mesh.vertices.size() == 25u * 25u);
+        CHECK(TriangleSet(mesh.vertices, mesh.indices) == triangles);
+
+        // First uses come in order 0, 1, 2, ...
+        unsigned int next = 0;
+        bool ordered = true;
+        for (unsigned int index : mesh.indices)
+        {
+            if (index > next) ordered = false;
+            if (index == next) next++;
+        }
+        CHECK(ordered && next == mesh.vertices.size());
+    }
+
+    // Anything that is not a triangle list is left alone
+    {
+        TestMesh mesh = MakeFlatGrid(2, 2);
+        mesh.indices.resize(mesh.indices.size() - 1);
+        const std::vector<unsigned int> indices = mesh.indices;
+        const size_t vertexCount = mesh.vertices.size();
+        MeshOptimizer::Optimize(mesh.vertices, mesh.indices);
+        CHECK(mesh.indices == indices && mesh.vertices.size() == vertexCount);
+
+        mesh = MakeFlatGrid(2, 2);
+        mesh.indices[0] = static_cast<unsigned int>(mesh.vertices.size());
+        const std::vector<unsigned int> outOfRange = mesh.indices;
+        MeshOptimizer::Optimize(mesh.vertices, mesh.indices);
+        CHECK(mesh.indices == outOfRange);
+    }
+
+    // Welding merges bit-identical vertices in first-use order and keeps every triangle
+    {
+        // A quad split into two triangles of its own, as an importer without joining hands it over
+        TestMesh quad = MakeFlatGrid(1, 1);
+        TestMesh split;
+        for (unsigned int index : quad.indices)
+        {
+            split.indices.push_back(static_cast<unsigned int>(split.vertices.size()));
+            split.vertices.push_back(quad.vertices[index]);
+        }
+        CHECK(split.vertices.size() == 6);
+        const auto triangles = TriangleSet(split.vertices, split.indices);
+        CHECK(MeshOptimizer::WeldVertices(split.vertices, split.indices) == 4);
+        CHECK(split.vertices.size() == 4);
+        CHECK((split.indices == std::vector<unsigned int>{0, 1, 2, 2, 1, 3}));
+        CHECK(TriangleSet(split.vertices, split.indices) == triangles);
+
+        // An exact copy of a corner welds back; one with a different UV is a
+        // texture seam and must stay split
+        TestMesh seam = MakeFlatGrid(1, 1);
+        seam.vertices.push_back(seam.vertices[3]);
+        seam.indices[5] = 4;
+        CHECK(MeshOptimizer::WeldVertices(seam.vertices, seam.indices) == 4);
+        CHECK(seam.indices[5] == 3);
+        seam.vertices.push_back(seam.vertices[3]);
+        seam.vertices.back().TexCoords.x += 0.5f;
+        seam.indices[5] = 4;
+        CHECK(MeshOptimizer::WeldVertices(seam.vertices, seam.indices) == 5);
+        CHECK(seam.indices[5] == 4);
+
+        // A whole exploded grid comes back to one vertex per grid point
+        TestMesh grid = ShuffledGrid();
+        TestMesh exploded;
+        for (unsigned int index : grid.indices)
+        {
+            exploded.indices.push_back(static_cast<unsigned int>(exploded.vertices.size()));
+            exploded.vertices.push_back(grid.vertices[index]);
+        }
+        const auto gridTriangles = TriangleSet(exploded.vertices, exploded.indices);
+        CHECK(MeshOptimizer::WeldVertices(exploded.vertices, exploded.indices) == 25u * 25u);
+        CHECK(TriangleSet(exploded.vertices, exploded.indices) == gridTriangles);
+
+        // Out-of-range indices leave the mesh alone
+        TestMesh broken = MakeFlatGrid(1, 1);
+        broken.vertices.push_back(broken.vertices[0]);
+        broken.indices[0] = 9;
+        const std::vector<unsigned int> brokenIndices = broken.indices;
+        CHECK(MeshOptimizer::WeldVertices(broken.vertices, broken.indices) == 5);
+        CHECK(broken.indices == brokenIndices);
+    }
+
+    // Geometry hashes agree for equal data and differ for any change to it
+    {
+        const TestMesh mesh = MakeFlatGrid(4, 4);
+        const uint64_t hash = MeshOptimizer::HashGeometry(mesh.vertices, mesh.indices);
+        TestMesh copy = mesh;
+        CHECK(MeshOptimizer::HashGeometry(copy.vertices, copy.indices) == hash);
+
+        copy.vertices[7].Normal.z = -0.0f;
+        CHECK(MeshOptimizer::HashGeometry(copy.vertices, copy.indices) != hash);
+        copy = mesh;
+        std::swap(copy.indices[0], copy.indices[1]);
+        CHECK(MeshOptimizer::HashGeometry(copy.vertices, copy.indices) != hash);
+        copy = mesh;
+        copy.vertices.push_back(Vertex());
+        CHECK(MeshOptimizer::HashGeometry(copy.vertices, copy.indices) != hash);
+        // The sizes are hashed too, so bytes cannot move between the two arrays unnoticed
+        CHECK(MeshOptimizer::HashGeometry({}, {}) != MeshOptimizer::HashGeometry({}, {0u}));
+    }
+
+    return CheckResult();
+}
@@ -0,0 +1,145 @@
+#include "Check.h"
+#include "TestMeshes.h"
+#include "utils/MeshSimplifier.h"
+#include <algorithm>
+#include <array>
+#include <map>
+
+// Every LOD is a valid triangle list inside the vertex buffer, the levels
+// follow each other in the index buffer, shrink and only grow in error
+static void CheckChain(const TestMesh& mesh, const std::vector<unsigned int>& indices, const std::vector<MeshLod>& lods)
+{
+    CHECK(!lods.empty());
+    CHECK(lods[0].firstIndex == 0 && lods[0].indexCount == mesh.indices.size() && lods[0].error == 0.0f);
+    CHECK(std::equal(mesh.indices.begin(), mesh.indices.end(), indices.begin()));
+    CHECK(lods.size() <= MeshSimplifier::kMaxLods);
+
+    for (size_t l = 1; l < lods.size(); l++)
+    {
+        CHECK(lods[l].firstIndex == lods[l - 1].firstIndex + lods[l - 1].indexCount);
+        CHECK(lods[l].indexCount % 3 == 0);
+        CHECK(lods[l].indexCount <= lods[l - 1].indexCount * 0.8f);
+        CHECK(lods[l].error >= lods[l - 1].error);
+        for (uint32_t i = lods[l].firstIndex; i < lods[l].firstIndex + lods[l].indexCount; i += 3)
+        {
+            CHECK(indices[i] < mesh.vertices.size() && indices[i + 1] < mesh.vertices.size() && indices[i + 2] < mesh.vertices.size());
+            CHECK(indices[i] != indices[i + 1] && indices[i + 1] != indices[i + 2] && indices[i] != indices[i + 2]);
+        }
+    }
+    CHECK(indices.size() == lods.back().firstIndex + lods.back().indexCount);
+}
+
+// Closed by position: every edge is matched by the reverse edge of a
+// neighbouring triangle, so there is no crack anywhere, seams included
+static bool Watertight(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const MeshLod& lod)
+{
+    auto key = [&](unsigned int v) {
+        // +0.0 folds -0.0 over, as the simplifier's own position hash does
+        glm::vec3 p = vertices[v].Position + glm::vec3(0.0f);
+        return std::array<float, 3>{p.x, p.y, p.z};
+    };
+    std::map<std::pair<std::array<float, 3>, std::array<float, 3>>, int> edges;
+    for (uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            auto a = key(indices[i + k]), b = key(indices[i + (k + 1) % 3]);
+            if (a == b) continue;
+            edges[{a, b}]++;
+            edges[{b, a}]--;
+        }
+    }
+    for (const auto& edge : edges)
+        if (edge.second != 0) return false;
+    return true;
+}
+
+static void TestFlatGrid()
+{
+    // Coplanar collapses cost nothing, and the open border never moves
+    TestMesh mesh = MakeFlatGrid(32, 32);
+    std::vector<unsigned int> indices = mesh.indices;
+    std::vector<MeshLod> lods = MeshSimplifier::BuildLodChain(mesh.vertices, indices);
+    CheckChain(mesh, indices, lods);
+    CHECK(lods.size() >= 2);
+
+    const unsigned int corners[4] = {0, 32, 33 * 32, 33 * 33 - 1};
+    for (size_t l = 1; l < lods.size(); l++)
+    {
+        CHECK(lods[l].error < 1e-4f);
+        for (unsigned int corner : corners)
+            CHECK(std::find(indices.begin() + lods[l].firstIndex, indices.begin() + lods[l].firstIndex + lods[l].indexCount,
+                            corner) != indices.begin() + lods[l].firstIndex + lods[l].indexCount);
+    }
+}
+
+static std::vector<MeshLod> TestSphere(bool negativeZeros)
+{
+    TestMesh mesh = MakeSphere(48, 24);
+    if (negativeZeros)
+    {
+        // Exporters write -0.0 freely. Flip the zeros of the closing seam
+        // column and of every other pole copy, so the seam (z = 0) and the
+        // poles have +0.0 and -0.0 copies that must still group.
+        for (size_t v = 0; v < mesh.vertices.size(); v++)
+        {
+            const size_t column = v % 49;
+            if (column != 48 && column % 2 == 0) continue;
+            glm::vec3& p = mesh.vertices[v].Position;
+            for (int c = 0; c < 3; c++)
+                if (p[c] == 0.0f) p[c] = -0.0f;
+        }
+    }
+    std::vector<unsigned int> indices = mesh.indices;
+    std::vector<MeshLod> lods = MeshSimplifier::BuildLodChain(mesh.vertices, indices);
+    CheckChain(mesh, indices, lods);
+    CHECK(lods.size() >= 2);
+    for (size_t l = 0; l < lods.size(); l++)
+        CHECK(Watertight(mesh.vertices, indices, lods[l]));
+    CHECK(lods.back().error > 0.0f && lods.back().error < 0.5f);
+    return lods;
+}
+
+static void TestSelectLod()
+{
+    // Object-space error per level; at 100 px per unit, level 2 is 1 px
+    const std::vector<float> errors = {0.0f, 0.004f, 0.01f, 0.04f};
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 100.0f, 1.0f) == 2);
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 1000.0f, 1.0f) == 0);
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 1.0f, 1.0f) == 3);
+    CHECK(MeshSimplifier::SelectLod(errors, 1, 1.0f, 1.0f) == 1);
+    CHECK(MeshSimplifier::SelectLod({0.0f}, 7, 1.0f, 1.0f) == 0);
+    CHECK(MeshSimplifier::SelectLod({}, 7, 1.0f, 1.0f) == 0);
+
+    // Hovering around the level 2 boundary: without state the choice flips
+    // every step, with state it holds until the error is 25% past the threshold
+    const float hysteresis = 0.25f;
+    int level = 1;
+    unsigned int switches = 0;
+    for (float pixelsPerUnit : {110.0f, 95.0f, 105.0f, 98.0f, 102.0f, 90.0f})
+    {
+        unsigned int next = MeshSimplifier::SelectLod(errors, 7, pixelsPerUnit, 1.0f, level, hysteresis);
+        if (static_cast<int>(next) != level) switches++;
+        level = static_cast<int>(next);
+    }
+    CHECK(level == 1 && switches == 0);
+    // 70 px per unit puts level 2 at 0.7 px, clearly under the threshold
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 70.0f, 1.0f, 1, hysteresis) == 2);
+    // Back at 1.2 px it stays; at 1.3 px it is clearly over and refines
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 120.0f, 1.0f, 2, hysteresis) == 2);
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 130.0f, 1.0f, 2, hysteresis) == 1);
+    // A previous level past the chain is clamped to the last one
+    CHECK(MeshSimplifier::SelectLod(errors, 7, 1.0f, 1.0f, 9, hysteresis) == 3);
+}
+
+int main()
+{
+    TestFlatGrid();
+    // -0.0 groups with +0.0, so the seam simplifies exactly as before
+    std::vector<MeshLod> positive = TestSphere(false), negative = TestSphere(true);
+    CHECK(positive.size() == negative.size());
+    for (size_t l = 0; l < std::min(positive.size(), negative.size()); l++)
+        CHECK(positive[l].indexCount == negative[l].indexCount && positive[l].error == negative[l].error);
+    TestSelectLod();
+    return CheckResult();
+}
@@ -0,0 +1,89 @@
+#include "Check.h"
+#include "TestMeshes.h"
+#include "utils/MeshOptimizer.h"
+#include <set>
+
+static glm::vec3 TriangleNormal(const TestMesh& mesh, size_t i)
+{
+    const glm::vec3& a = mesh.vertices[mesh.indices[i]].Position;
+    return glm::normalize(glm::cross(mesh.vertices[mesh.indices[i + 1]].Position - a, mesh.vertices[mesh.indices[i + 2]].Position - a));
+}
+
+// The meshlets cover the first indexCount indices back to back, each within
+// the limits, with bounds and a cone that hold every triangle they draw
+static void CheckMeshlets(const TestMesh& mesh, const std::vector<Meshlet>& meshlets, size_t indexCount,
+                          unsigned int maxVertices, unsigned int maxTriangles)
+{
+    uint32_t next = 0;
+    for (const Meshlet& meshlet : meshlets)
+    {
+        CHECK(meshlet.firstIndex == next);
+        CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+        CHECK(meshlet.indexCount / 3 <= maxTriangles);
+        next = meshlet.firstIndex + meshlet.indexCount;
+
+        std::set<unsigned int> used(mesh.indices.begin() + meshlet.firstIndex, mesh.indices.begin() + next);
+        CHECK(used.size() <= maxVertices);
+        for (unsigned int v : used)
+            CHECK(glm::length(mesh.vertices[v].Position - meshlet.center) <= meshlet.radius * 1.0001f + 1e-6f);
+
+        CHECK(meshlet.coneCutoff >= 0.0f && meshlet.coneCutoff <= 1.0f);
+        if (meshlet.coneCutoff < 1.0f)
+        {
+            // Normals may not lean further from the axis than the cone's half-angle
+            const float minDot = std::sqrt(1.0f - meshlet.coneCutoff * meshlet.coneCutoff);
+            for (uint32_t i = meshlet.firstIndex; i < next; i += 3)
+                CHECK(glm::dot(TriangleNormal(mesh, i), meshlet.coneAxis) >= minDot - 1e-4f);
+        }
+    }
+    CHECK(next == indexCount);
+}
+
+int main()
+{
+    // A flat grid splits at the triangle limit, and every cone is a single direction
+    {
+        TestMesh mesh = MakeFlatGrid(32, 32);
+        std::vector<Meshlet> meshlets = MeshOptimizer::BuildMeshlets(mesh.vertices, mesh.indices, mesh.indices.size());
+        CheckMeshlets(mesh, meshlets, mesh.indices.size(), 64, 124);
+        CHECK(meshlets.size() >= 2048 / 124);
+        for (const Meshlet& meshlet : meshlets)
+        {
+            CHECK(glm::dot(meshlet.coneAxis, glm::vec3(0.0f, 1.0f, 0.0f)) > 0.9999f);
+            CHECK(meshlet.coneCutoff < 1e-3f);
+        }
+    }
+
+    // On an optimized sphere the vertex limit bites too, and most clusters can be cone culled
+    {
+        TestMesh mesh = MakeSphere(48, 24);
+        MeshOptimizer::Optimize(mesh.vertices, mesh.indices);
+        for (unsigned int maxVertices : {64u, 32u})
+        {
+            std::vector<Meshlet> meshlets = MeshOptimizer::BuildMeshlets(mesh.vertices, mesh.indices, mesh.indices.size(), maxVertices);
+            CheckMeshlets(mesh, meshlets, mesh.indices.size(), maxVertices, 124);
+            size_t cullable = 0;
+            for (const Meshlet& meshlet : meshlets)
+                if (meshlet.coneCutoff < 1.0f) cullable++;
+            CHECK(cullable * 2 > meshlets.size());
+        }
+    }
+
+    // Only the first indexCount indices (LOD 0) are clustered
+    {
+        TestMesh mesh = MakeFlatGrid(32, 32);
+        const size_t lod0 = mesh.indices.size() / 2;
+        std::vector<Meshlet> meshlets = MeshOptimizer::BuildMeshlets(mesh.vertices, mesh.indices, lod0);
+        CheckMeshlets(mesh, meshlets, lod0, 64, 124);
+    }
+
+    // Meshes that fit in one meshlet, and index counts that are not triangle lists, get none
+    {
+        TestMesh mesh = MakeFlatGrid(4, 4);
+        CHECK(MeshOptimizer::BuildMeshlets(mesh.vertices, mesh.indices, mesh.indices.size()).empty());
+        mesh = MakeFlatGrid(32, 32);
+        CHECK(MeshOptimizer::BuildMeshlets(mesh.vertices, mesh.indices, mesh.indices.size() - 1).empty());
+    }
+
+    return CheckResult();
+}
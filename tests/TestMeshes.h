@@ -0,0 +1,116 @@
+#pragma once
+
+#include "utils/RenderTypes.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Small procedural meshes for the import-pass tests
+struct TestMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// (cols+1) x (rows+1) vertices over [0, 1]^2 in xz, y = height(x, z)
+template <typename Height>
+TestMesh MakeGrid(unsigned int cols, unsigned int rows, Height height)
+{
+    TestMesh mesh;
+    for (unsigned int r = 0; r <= rows; r++)
+    {
+        for (unsigned int c = 0; c <= cols; c++)
+        {
+            Vertex v;
+            float x = static_cast<float>(c) / cols, z = static_cast<float>(r) / rows;
+            v.Position = glm::vec3(x, height(x, z), z);
+            v.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            v.TexCoords = glm::vec2(x, z);
+            mesh.vertices.push_back(v);
+        }
+    }
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        for (unsigned int c = 0; c < cols; c++)
+        {
+            unsigned int i = r * (cols + 1) + c;
+            mesh.indices.insert(mesh.indices.end(), {i, i + cols + 1, i + 1, i + 1, i + cols + 1, i + cols + 2});
+        }
+    }
+    return mesh;
+}
+
+inline TestMesh MakeFlatGrid(unsigned int cols, unsigned int rows)
+{
+    return MakeGrid(cols, rows, [](float, float) { return 0.0f; });
+}
+
+// Closed UV sphere of radius 1; the seam column is duplicated like an exporter would
+inline TestMesh MakeSphere(unsigned int segments, unsigned int rings)
+{
+    TestMesh mesh;
+    const float pi = 3.14159265358979f;
+    for (unsigned int r = 0; r <= rings; r++)
+    {
+        for (unsigned int s = 0; s <= segments; s++)
+        {
+            float theta = pi * r / rings, phi = 2.0f * pi * s / segments;
+            Vertex v;
+            v.Position = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            // The seam column sits exactly on the first one, the poles on one point
+            if (s == segments) v.Position = mesh.vertices[mesh.vertices.size() - segments].Position;
+            if (r == 0 || r == rings) v.Position = glm::vec3(0.0f, r == 0 ? 1.0f : -1.0f, 0.0f);
+            v.Normal = v.Position;
+            v.TexCoords = glm::vec2(static_cast<float>(s) / segments, static_cast<float>(r) / rings);
+            mesh.vertices.push_back(v);
+        }
+    }
+    for (unsigned int r = 0; r < rings; r++)
+    {
+        for (unsigned int s = 0; s < segments; s++)
+        {
+            unsigned int i = r * (segments + 1) + s;
+            // Outward-facing, counter-clockwise seen from outside
+            if (r > 0) mesh.indices.insert(mesh.indices.end(), {i, i + 1, i + segments + 1});
+            if (r + 1 < rings) mesh.indices.insert(mesh.indices.end(), {i + 1, i + segments + 2, i + segments + 1});
+        }
+    }
+    return mesh;
+}
+
+inline void ShuffleTriangles(std::vector<unsigned int>& indices, unsigned int seed)
+{
+    std::vector<std::array<unsigned int, 3>> triangles(indices.size() / 3);
+    for (size_t t = 0; t < triangles.size(); t++)
+        triangles[t] = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
+    for (size_t t = 0; t < triangles.size(); t++)
+        for (int k = 0; k < 3; k++) indices[t * 3 + k] = triangles[t][k];
+}
+
+// Each triangle as its three positions, rotated to start at the smallest so
+// winding is kept; sorted, so two lists compare equal when they draw the same
+// triangles in any order and with any vertex numbering
+inline std::vector<std::array<float, 9>> TriangleSet(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                                     size_t first = 0, size_t count = ~size_t(0))
+{
+    count = std::min(count, indices.size() - first);
+    std::vector<std::array<float, 9>> set;
+    for (size_t i = first; i + 3 <= first + count; i += 3)
+    {
+        std::array<std::array<float, 3>, 3> corners;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec3& p = vertices[indices[i + k]].Position;
+            corners[k] = {p.x, p.y, p.z};
+        }
+        int start = static_cast<int>(std::min_element(corners.begin(), corners.end()) - corners.begin());
+        std::array<float, 9> triangle;
+        for (int k = 0; k < 3; k++)
+            for (int c = 0; c < 3; c++) triangle[k * 3 + c] = corners[(start + k) % 3][c];
+        set.push_back(triangle);
+    }
+    std::sort(set.begin(), set.end());
+    return set;
+}
@@ -0,0 +1,205 @@
+#include "Check.h"
+#include "utils/VertexFormat.h"
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static std::vector<Vertex> MakeVertices(bool outsideUnitSquare)
+{
+    std::vector<Vertex> vertices(64);
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        float t = static_cast<float>(i) / static_cast<float>(vertices.size() - 1);
+        vertices[i].Position = glm::vec3(t * 3.0f - 1.0f, std::sin(t * 7.0f), 0.5f);
+        vertices[i].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        vertices[i].TexCoords = glm::vec2(t, 1.0f - t) * (outsideUnitSquare ? 4.0f : 1.0f) - (outsideUnitSquare ? 1.5f : 0.0f);
+    }
+    return vertices;
+}
+
+static glm::vec2 DecodeUv(uint32_t format, const uint8_t* vertex)
+{
+    uint16_t uv[2];
+    std::memcpy(uv, vertex + 12, sizeof(uv));
+    if (format & VERTEX_FORMAT_UV_HALF) return glm::vec2(glm::unpackHalf1x16(uv[0]), glm::unpackHalf1x16(uv[1]));
+    return glm::vec2(uv[0], uv[1]) / 65535.0f;
+}
+
+// C++ versions of the vertex_decode.glsl helpers
+static glm::vec3 DecodeOctNormal(const uint8_t* vertex)
+{
+    int16_t packed[2];
+    std::memcpy(packed, vertex + 12, sizeof(packed));
+    glm::vec2 e = glm::max(glm::vec2(packed[0], packed[1]) / 32767.0f, glm::vec2(-1.0f));
+    glm::vec3 n(e, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if (n.z < 0.0f)
+    {
+        glm::vec2 sign(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * sign;
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return glm::normalize(n);
+}
+
+static glm::vec3 RotateByQuat(const glm::vec4& q, const glm::vec3& v)
+{
+    glm::vec3 u(q);
+    return v + 2.0f * glm::cross(u, glm::cross(u, v) + q.w * v);
+}
+
+// Columns tangent, bitangent, normal
+static glm::mat3 DecodeQTangent(const uint8_t* vertex)
+{
+    int16_t packed[4];
+    std::memcpy(packed, vertex + 12, sizeof(packed));
+    glm::vec4 q = glm::normalize(glm::max(glm::vec4(packed[0], packed[1], packed[2], packed[3]) / 32767.0f, glm::vec4(-1.0f)));
+    glm::vec3 t = RotateByQuat(q, glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::vec3 n = RotateByQuat(q, glm::vec3(0.0f, 0.0f, 1.0f));
+    float handedness = q.w < 0.0f ? -1.0f : 1.0f;
+    return glm::mat3(t, glm::cross(n, t) * handedness, n);
+}
+
+// A unit sphere's worth of normals and tangent frames of both handednesses
+static std::vector<Vertex> MakeLitVertices(bool skinned)
+{
+    std::vector<Vertex> vertices;
+    for (int i = 0; i < 24; i++)
+    {
+        for (int j = 0; j <= 12; j++)
+        {
+            float phi = 6.2831853f * i / 24.0f, theta = 3.14159265f * j / 12.0f;
+            Vertex v;
+            v.Normal = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            v.Tangent = glm::vec3(-std::sin(phi), 0.0f, std::cos(phi));
+            if (j == 0 || j == 12) v.Tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+            v.Bitangent = glm::cross(v.Normal, v.Tangent) * ((i + j) % 2 ? -1.0f : 1.0f);
+            v.TexCoords = glm::vec2(i / 24.0f, j / 12.0f);
+            if (skinned)
+            {
+                const int ids[4] = {i, j, 300, -2};
+                const float weights[4] = {0.5f, 0.25f, 0.25f, 0.0f};
+                for (int k = 0; k < 4; k++)
+                {
+                    v.m_BoneIDs[k] = ids[k];
+                    v.m_Weights[k] = weights[k];
+                }
+            }
+            vertices.push_back(v);
+        }
+    }
+    return vertices;
+}
+
+// Positions are copied bit for bit; uvs come back within half a quantization step
+static void CheckRoundTrip(const std::vector<Vertex>& vertices, uint32_t format, float uvTolerance)
+{
+    const VertexLayout& layout = GetVertexLayout(format);
+    std::vector<uint8_t> encoded(vertices.size() * layout.stride);
+    EncodeVertices(format, vertices.data(), vertices.size(), encoded.data());
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const uint8_t* vertex = encoded.data() + i * layout.stride;
+        CHECK(std::memcmp(vertex, &vertices[i].Position, sizeof(glm::vec3)) == 0);
+        glm::vec2 uv = DecodeUv(format, vertex + (format & VERTEX_FORMAT_QTANGENT ? 8 : format & VERTEX_FORMAT_NORMAL ? 4 : 0));
+        CHECK(std::abs(uv.x - vertices[i].TexCoords.x) <= uvTolerance);
+        CHECK(std::abs(uv.y - vertices[i].TexCoords.y) <= uvTolerance);
+    }
+}
+
+int main()
+{
+    // Every format is a compact layout and finds its way back to its index
+    for (uint32_t format = 0; format < kVertexFormatCount; format++)
+    {
+        const VertexLayout& layout = GetVertexLayout(format);
+        uint32_t found = ~0u;
+        CHECK(FindVertexFormat(layout, found) && found == format);
+        CHECK(layout.attributes[0].location == VERTEX_LOCATION_POSITION);
+        GLuint end = 0;
+        for (unsigned int a = 0; a < layout.attributeCount; a++)
+            end = std::max(end, layout.attributes[a].offset + VertexAttributeSize(layout.attributes[a]));
+        CHECK(end == layout.stride);
+    }
+    VertexLayout custom = GetVertexLayout(0);
+    uint32_t unused = 0;
+    CHECK(!FindVertexFormat(custom, unused));
+
+    // uvs in [0, 1] take unorm16, anything else half floats
+    std::vector<Vertex> inside = MakeVertices(false);
+    std::vector<Vertex> outside = MakeVertices(true);
+    CHECK(ChooseVertexFormat(inside.data(), inside.size()) == 0);
+    CHECK(ChooseVertexFormat(outside.data(), outside.size()) == VERTEX_FORMAT_UV_HALF);
+    CHECK(ChooseVertexFormat(nullptr, 0) == 0);
+
+    CheckRoundTrip(inside, 0, 0.5f / 65535.0f + 1e-7f);
+    // Half floats keep 11 significant bits; the largest magnitude here is 2.5
+    CheckRoundTrip(outside, VERTEX_FORMAT_UV_HALF, 2.5f / 2048.0f);
+
+    // Out-of-range values clamp rather than wrap when forced into unorm16
+    Vertex clamped;
+    clamped.TexCoords = glm::vec2(-0.25f, 1.75f);
+    uint8_t encoded[16];
+    EncodeVertices(0, &clamped, 1, encoded);
+    glm::vec2 uv = DecodeUv(0, encoded);
+    CHECK(uv.x == 0.0f && uv.y == 1.0f);
+
+    // Normal and tangent streams only for shaders that read them and meshes that have them
+    std::vector<Vertex> lit = MakeLitVertices(false);
+    std::vector<Vertex> skinned = MakeLitVertices(true);
+    CHECK(ChooseVertexFormat(lit.data(), lit.size()) == 0);
+    CHECK(ChooseVertexFormat(lit.data(), lit.size(), VERTEX_FORMAT_NORMAL) == VERTEX_FORMAT_NORMAL);
+    CHECK(ChooseVertexFormat(lit.data(), lit.size(), VERTEX_FORMAT_QTANGENT) == VERTEX_FORMAT_QTANGENT);
+    CHECK(ChooseVertexFormat(lit.data(), lit.size(), kVertexStreamFlags) == VERTEX_FORMAT_QTANGENT);
+    CHECK(ChooseVertexFormat(skinned.data(), skinned.size(), kVertexStreamFlags) == (VERTEX_FORMAT_QTANGENT | VERTEX_FORMAT_SKINNED));
+    CHECK(ChooseVertexFormat(skinned.data(), skinned.size(), VERTEX_FORMAT_NORMAL) == VERTEX_FORMAT_NORMAL);
+    // No tangents: a tangent-frame shader gets plain normals; no normals or weights: nothing
+    CHECK(ChooseVertexFormat(inside.data(), inside.size(), VERTEX_FORMAT_QTANGENT) == VERTEX_FORMAT_NORMAL);
+    Vertex bare;
+    CHECK(ChooseVertexFormat(&bare, 1, kVertexStreamFlags) == 0);
+
+    // Octahedral normals: two snorm16 keep the direction within 0.01 degrees
+    {
+        const uint32_t format = VERTEX_FORMAT_NORMAL;
+        CHECK(GetVertexLayout(format).stride == 20);
+        std::vector<uint8_t> encoded(lit.size() * 20);
+        EncodeVertices(format, lit.data(), lit.size(), encoded.data());
+        for (size_t i = 0; i < lit.size(); i++)
+        {
+            // The sine of the angle between them, which keeps its precision near zero
+            const glm::vec3 n = DecodeOctNormal(encoded.data() + i * 20);
+            CHECK(glm::dot(n, lit[i].Normal) > 0.0f && glm::length(glm::cross(n, lit[i].Normal)) < 1.75e-4f);
+        }
+        CheckRoundTrip(lit, format, 0.5f / 65535.0f + 1e-7f);
+    }
+
+    // QTangents: the whole frame, handedness included
+    {
+        const uint32_t format = VERTEX_FORMAT_QTANGENT | VERTEX_FORMAT_SKINNED;
+        const GLuint stride = GetVertexLayout(format).stride;
+        CHECK(stride == 32);
+        std::vector<uint8_t> encoded(skinned.size() * stride);
+        EncodeVertices(format, skinned.data(), skinned.size(), encoded.data());
+        for (size_t i = 0; i < skinned.size(); i++)
+        {
+            const uint8_t* vertex = encoded.data() + i * stride;
+            glm::mat3 frame = DecodeQTangent(vertex);
+            CHECK(glm::dot(frame[2], skinned[i].Normal) > 0.99999f);
+            CHECK(glm::dot(frame[0], skinned[i].Tangent) > 0.99999f);
+            CHECK(glm::dot(frame[1], skinned[i].Bitangent) > 0.99999f);
+
+            // Bone ids clamp to a byte, weights quantize to 1/255
+            const uint8_t* bones = vertex + 24;
+            for (int k = 0; k < 4; k++)
+            {
+                CHECK(bones[k] == std::min(std::max(skinned[i].m_BoneIDs[k], 0), 255));
+                CHECK(std::abs(bones[4 + k] / 255.0f - skinned[i].m_Weights[k]) <= 0.5f / 255.0f + 1e-6f);
+            }
+        }
+        CheckRoundTrip(skinned, format, 0.5f / 65535.0f + 1e-7f);
+    }
+
+    return CheckResult();
+}